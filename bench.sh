@@ -0,0 +1,52 @@
+#!/bin/bash
+
+# bench.sh COMPILER [BASELINE]
+# results are written to bench_results.tsv (suite, name, value, unit),
+# BASELINE is results file of previous run to compare with
+
+COMPILER=$1
+BASELINE=$2
+ARGS="-O2 -pthread -Wall -Werror -std=c++11 -Ir_lib"
+
+export BENCH_OUT=bench_results.tsv
+rm -f $BENCH_OUT
+
+run() {
+    rm -f ./a.out
+    $COMPILER $ARGS bench/$1 && ./a.out
+    if [ $? -ne 0 ]
+    then
+        echo "$1 failed"
+        exit 1
+    fi
+}
+
+run sip_decode.cpp
+run callback_emit.cpp
+run reg_contention.cpp
+run phis_cast.cpp
+run serialize.cpp
+run loopback.cpp
+run fleet.cpp
+run metrics.cpp
+
+echo "results: $BENCH_OUT"
+
+if [ -z "$BASELINE" ]
+then
+    exit 0
+fi
+
+# new / old, inverted for times and CPU load: below 1 is slower,
+# more than 10% slower is marked
+echo "compared with $BASELINE"
+awk -F '\t' '
+    NR == FNR { base[$1 FS $2] = $3; next }
+    $4 == "" || !(($1 FS $2) in base) || base[$1 FS $2] == 0 || $3 == 0 { next }
+    {
+        r = $3 / base[$1 FS $2]
+        if($4 == "ns" || $4 == "us" || $4 == "%")
+            r = 1 / r
+        printf "  %s, %s: %.2f%s\n", $1, $2, r, r < 0.9 ? "  SLOWER" : ""
+    }
+' "$BASELINE" "$BENCH_OUT"
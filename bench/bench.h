@@ -0,0 +1,101 @@
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace bench
+{
+
+template <typename F>
+double ns_per_op(size_t n, const F& f)
+{
+    using clock = std::chrono::steady_clock;
+
+    auto start = clock::now();
+    for(size_t i = 0; i < n; i++)
+        f();
+    auto t = clock::now() - start;
+
+    return std::chrono::duration<double, std::nano>(t).count() / n;
+}
+
+// v is read and written from compiler's point of view:
+// measured code is not hoisted out of loop or removed
+template <typename T>
+inline void keep(T& v)
+{
+    asm volatile("" : : "r"(&v) : "memory");
+}
+
+// p in [0, 100], nearest rank
+inline double percentile(std::vector<double> v, double p)
+{
+    if(v.empty())
+        return 0;
+
+    size_t i = std::min(v.size() - 1, size_t(p / 100 * v.size()));
+    std::nth_element(v.begin(), v.begin() + i, v.end());
+    return v[i];
+}
+
+// results of one benchmark: aligned text on stdout, and
+// "suite<TAB>name<TAB>value<TAB>unit" lines appended to $BENCH_OUT
+// to compare runs (see bench.sh)
+
+class report
+{
+    struct row
+    {
+        std::string name;
+        double value;
+        std::string unit; // empty for ratios
+    };
+
+    std::string suite;
+    std::string title;
+    std::vector<row> rows;
+public:
+    report(const std::string& s, const std::string& t): suite(s), title(t) {}
+
+    report(const report&) = delete;
+    report& operator=(const report&) = delete;
+
+    ~report()
+    {
+        size_t width = 0;
+        for(auto& r : rows)
+            width = std::max(width, r.name.size());
+
+        std::cout << title << std::endl;
+        for(auto& r : rows) {
+            std::cout << "  " << r.name << ":" << std::string(width - r.name.size() + 1, ' ');
+            std::cout << r.value;
+            if(!r.unit.empty())
+                std::cout << " " << r.unit;
+            std::cout << std::endl;
+        }
+
+        const char* path = std::getenv("BENCH_OUT");
+        if(!path)
+            return;
+
+        std::ofstream out(path, std::ios::app);
+        for(auto& r : rows)
+            out << suite << "\t" << r.name << "\t" << r.value << "\t" << r.unit << "\n";
+    }
+
+    void add(const std::string& name, double value, const std::string& unit = "")
+    {
+        rows.push_back(row{ name, value, unit });
+    }
+};
+
+}
+
+#endif // __BENCH_H__
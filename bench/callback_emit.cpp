@@ -0,0 +1,41 @@
+#include <iostream>
+
+#include <boost/signals2.hpp>
+
+#include "callback_list.h"
+#include "bench.h"
+
+using namespace robot;
+using bench::ns_per_op;
+
+int main()
+{
+    const size_t N = 10000000;
+    const size_t SLOTS = 2; // reg action and parameter update
+
+    volatile size_t calls = 0;
+    auto f = [&calls]() { calls = calls + 1; };
+
+    boost::signals2::signal<void()> sig;
+    callback_list list;
+
+    for(size_t i = 0; i < SLOTS; i++) {
+        sig.connect(f);
+        list.connect(f);
+    }
+
+    double t_sig  = ns_per_op(N, [&]() { sig(); });
+    double t_list = ns_per_op(N, [&]() { list(); });
+
+    if(calls != 2 * N * SLOTS) {
+        std::cerr << "call count mismatch" << std::endl;
+        return 1;
+    }
+
+    bench::report r("callback_emit", "emit, " + std::to_string(SLOTS) + " slots");
+    r.add("boost::signals2", t_sig, "ns");
+    r.add("callback_list", t_list, "ns");
+    r.add("speedup", t_sig / t_list);
+
+    return 0;
+}
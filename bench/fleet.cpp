@@ -0,0 +1,98 @@
+#include <atomic>
+#include <iostream>
+#include <thread>
+
+#include <pthread.h>
+#include <time.h>
+
+#include "../device/p2at_sim.h"
+#include "../device/p2at_gateway.h"
+#include "bench.h"
+
+using namespace robot;
+using namespace robot::p2at;
+
+// simulated robots on one thread, gateway of one server on workers:
+// CPU of gateway per robot and delivered SIPs
+
+enum { BASE_PORT = 8401, SERVER_PORT = 5298 };
+
+double cpu_seconds(clockid_t id)
+{
+    timespec t;
+    clock_gettime(id, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+size_t sips_sent(const std::vector<std::unique_ptr<simulator>>& sims)
+{
+    size_t n = 0;
+    for(auto& s : sims)
+        n += s->get_counters().sips;
+    return n;
+}
+
+int main()
+{
+    const uint32_t RATE = 1000; // SIPs per second per robot
+    const double T = 1.0;
+
+    bench::report rep("fleet", "gateway, simulated robots, 1000 SIP/s, 16 sonars");
+
+    for(size_t robots : { 4, 16 }) {
+        multi_server srv(INADDR_LOOPBACK, SERVER_PORT);
+
+        reactor sim_loop;
+        std::vector<std::unique_ptr<simulator>> sims;
+        std::vector<robot_address> addrs;
+
+        for(size_t i = 0; i < robots; i++) {
+            uint16_t port = BASE_PORT + i;
+            sims.emplace_back(new simulator(sim_loop, INADDR_LOOPBACK, port, sim_config(16, RATE)));
+            addrs.push_back(robot_address{ INADDR_LOOPBACK, port });
+        }
+
+        gateway fleet(srv, addrs, 2);
+
+        // robots: own thread, its CPU is not counted
+        std::atomic<bool> stop(false);
+        std::thread sim_thread
+        (
+            [&]()
+            {
+                while(!stop)
+                    sim_loop.run_once(1);
+            }
+        );
+
+        clockid_t sim_clock;
+        pthread_getcpuclockid(sim_thread.native_handle(), &sim_clock);
+
+        // handshakes included
+        auto start = std::chrono::steady_clock::now();
+        double cpu = cpu_seconds(CLOCK_PROCESS_CPUTIME_ID);
+        double sim_cpu = cpu_seconds(sim_clock);
+
+        fleet.start();
+        std::this_thread::sleep_for(std::chrono::duration<double>(T));
+
+        cpu = cpu_seconds(CLOCK_PROCESS_CPUTIME_ID) - cpu;
+        sim_cpu = cpu_seconds(sim_clock) - sim_cpu;
+        double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        fleet.stop();
+        stop = true;
+        sim_thread.join();
+
+        size_t sips = sips_sent(sims);
+
+        // gateway workers, main thread sleeps
+        double gateway_cpu = cpu - sim_cpu;
+
+        std::string n = std::to_string(robots) + " robots";
+        rep.add(n + ", SIPs", sips / wall, "msgs/s");
+        rep.add(n + ", gateway CPU per robot", 100 * gateway_cpu / wall / robots, "%");
+    }
+
+    return 0;
+}
@@ -0,0 +1,121 @@
+#include <iostream>
+#include <thread>
+
+#include "device.h"
+#include "tcp.h"
+#include "multi_server.h"
+#include "bench.h"
+
+using namespace robot;
+using namespace robot::common_protocol;
+
+// server thread and protocol client over loopback TCP
+
+enum { PORT = 5299 };
+
+int main()
+{
+    using clock = std::chrono::steady_clock;
+
+    multi_server srv(INADDR_LOOPBACK, PORT);
+
+    std::array<reg<second<uint32_t>, READ_FLAG>, 8> regs;
+
+    auto& f = srv.get_function_ref(2, 0);
+    for(uint8_t i = 0; i < regs.size(); i++) {
+        f[i] = regs[i].make_parameter(i);
+        regs[i].set(second<uint32_t>(i));
+    }
+
+    std::thread server_thread([&srv]() { srv.run(); });
+
+    tcp_socket s = tcp_client(INADDR_LOOPBACK, PORT);
+    s.set_no_delay();
+    connection cli(s);
+
+    function_value_read_request req;
+    std::get<0>(req) = function_id_t(2, 0);
+    for(uint8_t i = 0; i < regs.size(); i++)
+        std::get<1>(req).push_back(std::tuple<uint8_t, uint8_t>(i, 0));
+
+    uint32_t msg_num = 0;
+
+    auto send =
+    [&]()
+    {
+        cli.write_stream
+        (
+            [&](binary_ostream& os)
+            {
+                write_message
+                <
+                    data_access_group_key,
+                    function_value_read_request_key
+                >(os, req, ++msg_num);
+            }
+        );
+    };
+
+    bool ok = true;
+    auto receive =
+    [&]()
+    {
+        message_header header;
+        cli.read(header);
+        cli.read_stream(get<data_size_key>(header));
+        ok = ok && get<type_key>(header) == function_value_read_key::value;
+    };
+
+    // warm up: connection buffers, caches
+    for(size_t i = 0; i < 1000; i++) {
+        send();
+        receive();
+    }
+
+    // one request in flight: round trip latency
+    const size_t N = 20000;
+    std::vector<double> rtt;
+    rtt.reserve(N);
+
+    auto start = clock::now();
+    for(size_t i = 0; i < N; i++) {
+        auto t = clock::now();
+        send();
+        receive();
+        rtt.push_back(std::chrono::duration<double, std::micro>(clock::now() - t).count());
+    }
+    double t_serial = std::chrono::duration<double>(clock::now() - start).count();
+
+    // pipelined requests: server throughput
+    const size_t WINDOW = 64;
+    const size_t ROUNDS = 2000;
+
+    start = clock::now();
+    for(size_t r = 0; r < ROUNDS; r++) {
+        {
+            write_batch b(cli);
+            for(size_t i = 0; i < WINDOW; i++)
+                send();
+        }
+        for(size_t i = 0; i < WINDOW; i++)
+            receive();
+    }
+    double t_pipelined = std::chrono::duration<double>(clock::now() - start).count();
+
+    s.close();
+    srv.get_reactor().post([&srv]() { srv.stop(); });
+    server_thread.join();
+
+    if(!ok) {
+        std::cerr << "unexpected reply" << std::endl;
+        return 1;
+    }
+
+    bench::report rep("loopback", "loopback TCP, function_value_read of 8 parameters");
+    rep.add("round trip p50", bench::percentile(rtt, 50), "us");
+    rep.add("round trip p99", bench::percentile(rtt, 99), "us");
+    rep.add("one in flight", N / t_serial, "msgs/s");
+    rep.add(std::to_string(WINDOW) + " in flight", WINDOW * ROUNDS / t_pipelined, "msgs/s");
+
+    return 0;
+}
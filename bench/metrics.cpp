@@ -0,0 +1,100 @@
+#include <iostream>
+
+#include "device.h"
+#include "bench.h"
+
+using namespace robot;
+using namespace robot::common_protocol;
+using bench::ns_per_op;
+
+// socket replaying one serialized request, replies are dropped
+
+struct replay_socket
+{
+    std::shared_ptr<std::vector<char>> data;
+    std::shared_ptr<size_t> pos;
+
+    int read(char* dst, int size)
+    {
+        std::copy(data->data() + *pos, data->data() + *pos + size, dst);
+        *pos = (*pos + size) % data->size();
+        return size;
+    }
+
+    int write(const char*, int size) { return size; }
+};
+
+int main()
+{
+    const size_t N = 1000000;
+
+    // primitives
+    double t_count =
+    ns_per_op(N, []() { metrics::message(data_access_group_key::value, 0); });
+
+    uint64_t v = 0;
+    double t_record =
+    ns_per_op(N, [&v]() { metrics::record(metrics::DECODE, ++v & 0xFFFF); });
+
+    double t_timer =
+    ns_per_op(N, []() { metrics::scope_timer t(metrics::ENCODE); });
+
+    metrics::set_sample_period(1);
+    double t_timer_all =
+    ns_per_op(N, []() { metrics::scope_timer t(metrics::ENCODE); });
+    metrics::set_sample_period(64);
+
+    metrics::set_enabled(false);
+    double t_timer_off =
+    ns_per_op(N, []() { metrics::scope_timer t(metrics::ENCODE); });
+    metrics::set_enabled(true);
+
+    bench::report rep("metrics", "metrics recording, per call");
+    rep.add("message count", t_count, "ns");
+    rep.add("histogram record", t_record, "ns");
+    rep.add("scope timer, 1 of 64 sampled", t_timer, "ns");
+    rep.add("scope timer, every call", t_timer_all, "ns");
+    rep.add("scope timer, switched off", t_timer_off, "ns");
+
+    // whole message path: read, decode, dispatch, reply encode
+    auto state = std::make_shared<robot_state>();
+    std::array<reg<second<uint32_t>, READ_FLAG>, 8> regs;
+
+    auto& f = state->get_function_ref(2, 0);
+    for(uint8_t i = 0; i < regs.size(); i++) {
+        f[i] = regs[i].make_parameter(i);
+        regs[i].set(second<uint32_t>(i));
+    }
+
+    function_value_read_request req;
+    std::get<0>(req) = function_id_t(2, 0);
+    for(uint8_t i = 0; i < regs.size(); i++)
+        std::get<1>(req).push_back(std::tuple<uint8_t, uint8_t>(i, 0));
+
+    replay_socket s{ std::make_shared<std::vector<char>>(), std::make_shared<size_t>(0) };
+    {
+        binary_ostream os(*s.data);
+        write_message<data_access_group_key, function_value_read_request_key>(os, req);
+        s.data->resize(os.pos());
+    }
+
+    server srv(s, state);
+
+    // switched on and off in turns: same cache and frequency state
+    double t_on = 0, t_off = 0;
+    for(size_t round = 0; round < 5; round++) {
+        metrics::set_enabled(true);
+        t_on += ns_per_op(N / 5, [&srv]() { srv.server_package_parse(); });
+
+        metrics::set_enabled(false);
+        t_off += ns_per_op(N / 5, [&srv]() { srv.server_package_parse(); });
+    }
+    metrics::set_enabled(true);
+
+    bench::report msg("metrics_overhead", "server_package_parse, function_value_read of 8 parameters");
+    msg.add("metrics on", t_on / 5, "ns");
+    msg.add("metrics off", t_off / 5, "ns");
+    msg.add("overhead", 100 * (t_on - t_off) / t_off, "%");
+
+    return 0;
+}
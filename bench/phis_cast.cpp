@@ -0,0 +1,107 @@
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include "dimension.h"
+#include "bench.h"
+
+using namespace robot;
+using bench::ns_per_op;
+
+using mm = dec_factor<-3, metre<int16_t>>;
+
+// previous conversion: pow(10, n) per basic unit, double round trip
+template <typename V, int Exp>
+V pow_convert(V v)
+{
+    return Exp > 0 ? v * pow(10, Exp) : v / pow(10, -Exp);
+}
+
+int main()
+{
+    const size_t N = 1000;
+    const size_t R = 10000;
+
+    std::vector<metre<int16_t>> src(N);
+    std::vector<mm> dst(N);
+
+    for(size_t i = 0; i < N; i++)
+        src[i] = metre<int16_t>(i % 32);
+
+    double t_pow =
+    ns_per_op
+    (
+        R,
+        [&]()
+        {
+            for(size_t i = 0; i < N; i++)
+                dst[i] = mm(pow_convert<int16_t, 3>(src[i].get_value()));
+        }
+    ) / N;
+
+    long check = 0;
+    for(auto& v : dst)
+        check += v.get_value();
+
+    double t_cast =
+    ns_per_op
+    (
+        R,
+        [&]()
+        {
+            for(size_t i = 0; i < N; i++)
+                dst[i] = phis_cast<mm>(src[i]);
+        }
+    ) / N;
+
+    for(auto& v : dst)
+        check -= v.get_value();
+
+    if(check != 0) {
+        std::cerr << "conversion mismatch" << std::endl;
+        return 1;
+    }
+
+    // sonar ranges to metres: element loop vs range conversion
+    std::vector<metre<double>> out(N);
+
+    double t_elem =
+    ns_per_op
+    (
+        R,
+        [&]()
+        {
+            for(size_t i = 0; i < N; i++)
+                out[i] = metre<double>(pow_convert<double, -3>(dst[i].get_value()));
+        }
+    ) / N;
+
+    double sum = 0;
+    for(auto& v : out)
+        sum += v.get_value();
+
+    double t_range =
+    ns_per_op(R, [&]() { phis_cast(dst.data(), out.data(), N); }) / N;
+
+    for(auto& v : out)
+        sum -= v.get_value();
+
+    if(std::abs(sum) > 1e-6) {
+        std::cerr << "range conversion mismatch" << std::endl;
+        return 1;
+    }
+
+    {
+        bench::report r("phis_cast", "phis_cast metre<int16_t> => mm");
+        r.add("pow, double", t_pow, "ns");
+        r.add("constant factor", t_cast, "ns");
+        r.add("speedup", t_pow / t_cast);
+    }
+
+    bench::report r("phis_cast_range", "phis_cast range mm => metre<double>");
+    r.add("pow, per element", t_elem, "ns");
+    r.add("range", t_range, "ns");
+    r.add("speedup", t_elem / t_range);
+
+    return 0;
+}
@@ -0,0 +1,79 @@
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "device.h"
+#include "bench.h"
+
+using namespace robot;
+
+using sonar_array = std::array<second<uint32_t>, 16>;
+
+// reads per reader per microsecond while one writer updates continuously
+template <typename V>
+double reads_per_us(size_t readers)
+{
+    V value;
+
+    std::atomic<bool> stop(false);
+    std::atomic<size_t> reads(0);
+
+    std::thread writer
+    (
+        [&]()
+        {
+            uint32_t n = 0;
+            while(!stop) {
+                sonar_array a;
+                a.fill(second<uint32_t>(n++));
+                value.store(a);
+            }
+        }
+    );
+
+    std::vector<std::thread> threads;
+    for(size_t i = 0; i < readers; i++)
+        threads.push_back
+        (
+            std::thread
+            (
+                [&]()
+                {
+                    size_t n = 0;
+                    volatile uint32_t sink;
+                    while(!stop) {
+                        sink = value.load()[7].get_value();
+                        n++;
+                    }
+                    (void)sink;
+                    reads += n;
+                }
+            )
+        );
+
+    const auto t = std::chrono::milliseconds(300);
+    std::this_thread::sleep_for(t);
+    stop = true;
+
+    writer.join();
+    for(auto& th : threads)
+        th.join();
+
+    using us = std::chrono::microseconds;
+    return double(reads) / readers / std::chrono::duration_cast<us>(t).count();
+}
+
+int main()
+{
+    bench::report r("reg_contention", "reg value read, 16 x uint32, one writer, per reader");
+
+    for(size_t n : { 1, 2, 4 }) {
+        std::string readers = std::to_string(n) + " readers";
+
+        r.add("mutex, " + readers, reads_per_us<locked_value<sonar_array>>(n), "reads/us");
+        r.add("seqlock, " + readers, reads_per_us<seqlock_value<sonar_array>>(n), "reads/us");
+    }
+
+    return 0;
+}
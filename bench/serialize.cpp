@@ -0,0 +1,218 @@
+#include <iostream>
+
+#include "device.h"
+#include "../device/pioneer_2at.h"
+#include "bench.h"
+
+using namespace robot;
+using namespace robot::common_protocol;
+using bench::ns_per_op;
+
+int main()
+{
+    const size_t N = 1000000;
+
+    std::vector<char> arena;
+    size_t sink = 0;
+
+    // constant size message
+    {
+        message<service_group_key, active_connections_info_key> m, r;
+        get<max_control_prior_key>(get<body_key>(m)) = 7;
+
+        double t_write =
+        ns_per_op
+        (
+            N,
+            [&]()
+            {
+                binary_ostream os(arena);
+                os << m;
+                sink += os.pos();
+            }
+        );
+
+        double t_read =
+        ns_per_op
+        (
+            N,
+            [&]()
+            {
+                bench::keep(arena);
+                binary_istream is(arena.data(), calc_size(m));
+                is >> r;
+                bench::keep(r);
+            }
+        );
+
+        if(get<max_control_prior_key>(get<body_key>(r)) != 7) {
+            std::cerr << "message mismatch" << std::endl;
+            return 1;
+        }
+
+        bench::report rep("serialize_constant", "active_connections_info message");
+        rep.add("binary_ostream", t_write, "ns");
+        rep.add("binary_istream", t_read, "ns");
+    }
+
+    // variable size request and its reply, 20 parameters
+    {
+        robot_state state;
+        std::array<reg<second<uint32_t>, READ_FLAG>, 20> regs;
+
+        auto& f = state.get_function_ref(2, 0);
+        for(uint8_t i = 0; i < regs.size(); i++) {
+            f[i] = regs[i].make_parameter(i);
+            regs[i].set(second<uint32_t>(i));
+        }
+
+        function_value_read_request req, decoded;
+        std::get<0>(req) = function_id_t(2, 0);
+        for(uint8_t i = 0; i < regs.size(); i++)
+            std::get<1>(req).push_back(std::tuple<uint8_t, uint8_t>(i, 0));
+
+        double t_size =
+        ns_per_op
+        (
+            N,
+            [&]()
+            {
+                bench::keep(req);
+                sink += calc_size(req);
+            }
+        );
+
+        size_t size = 0;
+        double t_write =
+        ns_per_op
+        (
+            N,
+            [&]()
+            {
+                binary_ostream os(arena);
+                write_message<data_access_group_key, function_value_read_request_key>(os, req);
+                size = os.pos();
+            }
+        );
+
+        size_t header = static_size<message_header>::value;
+        double t_read =
+        ns_per_op
+        (
+            N,
+            [&]()
+            {
+                bench::keep(arena);
+                binary_istream is(arena.data() + header, size - header);
+                is >> decoded;
+                bench::keep(decoded);
+            }
+        );
+
+        if(std::get<1>(decoded).size() != regs.size()) {
+            std::cerr << "request mismatch" << std::endl;
+            return 1;
+        }
+
+        function_value_read reply;
+        double t_values = ns_per_op(N, [&]() { state.get_read_values(req, reply); });
+
+        double t_reply =
+        ns_per_op
+        (
+            N,
+            [&]()
+            {
+                binary_ostream os(arena);
+                write_message<data_access_group_key, function_value_read_key>(os, reply);
+                sink += os.pos();
+            }
+        );
+
+        bench::report rep("serialize_read", "function_value_read, 20 parameters");
+        rep.add("request calc_size", t_size, "ns");
+        rep.add("request write_message", t_write, "ns");
+        rep.add("request binary_istream", t_read, "ns");
+        rep.add("reply get_read_values", t_values, "ns");
+        rep.add("reply write_message", t_reply, "ns");
+    }
+
+    // any: type erased value through binary streams
+    {
+        second<uint32_t> v(5), in;
+
+        double t_copy =
+        ns_per_op
+        (
+            N,
+            [&]()
+            {
+                any a = make_storage(v);
+                binary_ostream os(arena);
+                a.write(os);
+
+                binary_istream is(arena.data(), os.pos());
+                any b = make_storage_ref(in);
+                b.read(is);
+            }
+        );
+
+        std::array<second<uint32_t>, 16> arr, arr_in;
+        arr.fill(second<uint32_t>(3));
+
+        double t_ref =
+        ns_per_op
+        (
+            N,
+            [&]()
+            {
+                any a = make_storage_ref(arr);
+                binary_ostream os(arena);
+                a.write(os);
+
+                binary_istream is(arena.data(), os.pos());
+                any b = make_storage_ref(arr_in);
+                b.read(is);
+            }
+        );
+
+        if(in.get_value() != 5 || arr_in[15].get_value() != 3) {
+            std::cerr << "any mismatch" << std::endl;
+            return 1;
+        }
+
+        bench::report rep("any", "any round trip, write and read");
+        rep.add("second<uint32_t> copy", t_copy, "ns");
+        rep.add("16 x second<uint32_t> ref", t_ref, "ns");
+    }
+
+    // P2AT check sum
+    {
+        char data[255];
+        for(size_t i = 0; i < sizeof(data); i++)
+            data[i] = char(i * 7);
+
+        bench::report rep("p2at_chck_sum", "p2at::chck_sum_calc");
+
+        for(uint16_t n : { 16, 75, 253 }) {
+            double t =
+            ns_per_op
+            (
+                N,
+                [&]()
+                {
+                    bench::keep(data);
+                    sink += p2at::chck_sum_calc(data, n);
+                }
+            );
+            rep.add(std::to_string(n) + " bytes", t, "ns");
+        }
+    }
+
+    if(sink == 0) {
+        std::cerr << "nothing measured" << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,125 @@
+#include <iostream>
+
+#include "../device/pioneer_2at.h"
+#include "bench.h"
+
+using namespace robot;
+using namespace robot::p2at;
+using bench::ns_per_op;
+
+// bounds check before every value: decoding without check hoisting
+
+class checked_istream
+{
+    binary_istream& is;
+public:
+    checked_istream(binary_istream& s): is(s) {}
+
+    template <typename T>
+    typename
+    std::enable_if
+    <
+        std::is_arithmetic<T>::value &&
+        !std::is_const<T>::value,
+        checked_istream&
+    >::type
+    operator >> (T& t)
+    {
+        is >> t;
+        return *this;
+    }
+};
+
+using sip_body = at_key<msg_body, p2_at_msg<sip>>;
+
+int main()
+{
+    // SIP with 16 sonar readings
+    sip_body body;
+    auto& data = get<msg_data>(body);
+    get<x_pos_key>(data) = 100;
+    get<compass>(data) = 7;
+
+    auto& sonars = get<sonar_measurements>(data);
+    sonars.resize(16);
+    for(size_t i = 0; i < sonars.size(); i++) {
+        get<sonar_number>(sonars[i]) = i;
+        get<sonar_range>(sonars[i]) = mm(1000 + i);
+    }
+
+    std::vector<char> packet;
+    binary_ostream os(packet);
+    os << body;
+    packet.resize(os.pos());
+
+    const size_t N = 1000000;
+
+    sip_body hoisted, checked;
+    get<sonar_measurements>(get<msg_data>(hoisted)).reserve(16);
+    get<sonar_measurements>(get<msg_data>(checked)).reserve(16);
+
+    double t_checked =
+    ns_per_op
+    (
+        N,
+        [&]()
+        {
+            binary_istream is(packet.data(), packet.size());
+            checked_istream c(is);
+            c >> checked;
+        }
+    );
+
+    double t_hoisted =
+    ns_per_op
+    (
+        N,
+        [&]()
+        {
+            binary_istream is(packet.data(), packet.size());
+            is >> hoisted;
+        }
+    );
+
+    // in place view: check sum validation and field loads, no decoding
+    get<msg_chck_sum>(body) = chck_sum_calc(packet.data(), packet.size() - 2);
+    binary_ostream fix(packet.data() + packet.size() - 2, 2);
+    fix << get<msg_chck_sum>(body);
+
+    long sum = 0;
+    double t_view =
+    ns_per_op
+    (
+        N,
+        [&]()
+        {
+            sip_view v(packet.data(), packet.size());
+            for(auto it = v.sonars_begin(); it != v.sonars_end(); ++it)
+                sum += get<sonar_range>(*it).get_value();
+        }
+    );
+
+    if(sum != long(N) * (16 * 1000 + 15 * 16 / 2)) {
+        std::cerr << "view mismatch" << std::endl;
+        return 1;
+    }
+
+    auto& h = get<sonar_measurements>(get<msg_data>(hoisted));
+    auto& c = get<sonar_measurements>(get<msg_data>(checked));
+
+    if(h.size() != 16 || get<sonar_range>(h[15]).get_value() != 1015 ||
+       get<sonar_range>(c[15]).get_value() != 1015 ||
+       get<compass>(get<msg_data>(hoisted)) != 7)
+    {
+        std::cerr << "decode mismatch" << std::endl;
+        return 1;
+    }
+
+    bench::report r("sip_decode", "sip decode, " + std::to_string(packet.size()) + " bytes");
+    r.add("per value checks", t_checked, "ns");
+    r.add("hoisted checks", t_hoisted, "ns");
+    r.add("speedup", t_checked / t_hoisted);
+    r.add("sip_view, check sum and sonars", t_view, "ns");
+
+    return 0;
+}
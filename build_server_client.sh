@@ -7,3 +7,4 @@ killall server
 
 $CXX $OPTS $INCLUDE ./server.cpp; mv ./a.out server
 $CXX $OPTS $INCLUDE ./client.cpp; mv ./a.out client
+$CXX $OPTS $INCLUDE ./p2at_sim.cpp; mv ./a.out p2at_sim
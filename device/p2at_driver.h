@@ -0,0 +1,541 @@
+#ifndef __P2AT_DRIVER__
+#define __P2AT_DRIVER__
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "metrics.h"
+#include "reactor.h"
+#include "pioneer_2at.h"
+
+namespace robot
+{
+namespace p2at
+{
+
+///////////////////////////////////////////////////////////
+//
+//                  non-blocking P2AT driver
+//
+///////////////////////////////////////////////////////////
+
+// time limits of robot link, microseconds
+struct link_timeouts
+{
+    uint64_t reply;     // handshake step, connect
+    uint64_t sip;       // silence while running
+    uint64_t pulse;     // keepalive period
+    uint64_t tick;      // deadline check period
+    uint64_t retry;     // first reconnect delay, doubled after each failure
+    uint64_t max_retry; // reconnect delay limit
+
+    link_timeouts
+    (
+        uint64_t r = 1000000,
+        uint64_t s = 1000000,
+        uint64_t p = 500000,
+        uint64_t t = 100000,
+        uint64_t rt = 100000,
+        uint64_t mrt = 5000000
+    ):
+        reply(r),
+        sip(s),
+        pulse(p),
+        tick(t),
+        retry(rt),
+        max_retry(mrt)
+    {}
+};
+
+// SYNC0/1/2 handshake, OPEN and ENABLE, then SIP stream with PULSE
+// keepalive, all on reactor thread; packets are framed by scanning
+// for 0xFA 0xFB head, so garbage and corrupted packets are skipped,
+// missed deadline restarts handshake from SYNC0; driver made with robot
+// address reconnects with backoff after link loss, driver on given
+// socket is closed; driver is closed and destroyed on reactor thread or
+// after its loop is stopped, posted commands of destroyed driver are
+// dropped
+
+class driver
+{
+public:
+    using sip_handler_t = std::function<void(const sip_view&)>;
+
+    enum state_t : uint8_t { SYNC0, SYNC1, SYNC2, RUNNING };
+
+    // link statistics
+    struct counters
+    {
+        size_t packets;  // valid packets
+        size_t skipped;  // bytes dropped while searching head
+        size_t bad;        // packets with wrong check sum or layout
+        size_t restarts;   // handshakes restarted by deadline
+        size_t reconnects; // connection attempts after failure or link loss
+    };
+private:
+    using clock = timer_wheel::clock;
+
+    enum { READ_CHUNK = 4096 };
+    enum { MAX_OUTPUT_BACKLOG = 1 << 16 };
+
+    reactor& loop;
+    tcp_socket socket;
+    sip_handler_t on_sip;
+    link_timeouts timeouts;
+
+    // robot address, port 0 - no reconnect
+    uint32_t ip;
+    uint16_t port;
+
+    // written by reactor thread, polled by others
+    std::atomic<state_t> state;
+    std::atomic<bool> closed;
+
+    counters stat;
+
+    bool connecting; // non-blocking connect is not finished
+    bool retry_pending;
+    reactor::timer_id retry_timer;
+    uint64_t backoff;
+
+    std::vector<char> rx;
+
+    std::vector<char> tx;
+    size_t tx_offset;
+    uint32_t events;
+
+    reactor::timer_id tick_timer;
+    clock::time_point deadline;
+    clock::time_point last_pulse;
+
+    metrics::interval_meter sip_interval; // jitter of SIP stream
+
+    // posted closures outlive driver
+    std::shared_ptr<driver*> self;
+
+    static clock::duration us(uint64_t t) { return std::chrono::microseconds(t); }
+
+    bool connected() const { return socket.handle() >= 0; }
+
+    void connect()
+    {
+        socket = tcp_connect_nonblocking(ip, port);
+        if(!connected()) {
+            schedule_retry();
+            return;
+        }
+
+        // writable: connect is finished
+        connecting = true;
+        events = reactor::WRITE_EVENT;
+        deadline = clock::now() + us(timeouts.reply);
+        loop.add(socket.handle(), events, [this](uint32_t ev) { this->on_event(ev); });
+    }
+
+    void on_connected()
+    {
+        connecting = false;
+        socket.set_no_delay();
+        start_sync();
+        send_output();
+    }
+
+    void schedule_retry()
+    {
+        ++stat.reconnects;
+        retry_pending = true;
+        retry_timer =
+        loop.add_timer
+        (
+            backoff,
+            [this]()
+            {
+                this->retry_pending = false;
+                this->connect();
+            }
+        );
+        backoff = std::min(2 * backoff, timeouts.max_retry);
+    }
+
+    // socket error or EOF: robot stops by its own watchdog,
+    // link is connected again if robot address is known
+    void lost()
+    {
+        if(port == 0) {
+            close();
+            return;
+        }
+
+        loop.remove(socket.handle());
+        socket.close();
+        socket = tcp_socket(-1);
+
+        connecting = false;
+        state = SYNC0;
+        rx.clear();
+        tx.clear();
+        tx_offset = 0;
+
+        schedule_retry();
+    }
+
+    void update_events()
+    {
+        uint32_t ev = reactor::READ_EVENT;
+        if(tx_offset != tx.size())
+            ev |= reactor::WRITE_EVENT;
+
+        if(ev != events) {
+            loop.modify(socket.handle(), ev);
+            events = ev;
+        }
+    }
+
+    // send as much as socket accepts
+    void flush()
+    {
+        while(tx_offset != tx.size()) {
+            int n = socket.write_some(tx.data() + tx_offset, tx.size() - tx_offset);
+
+            if(n < 0) {
+                if(!would_block())
+                    lost();
+                return;
+            }
+
+            tx_offset += n;
+        }
+
+        tx.clear(); // keeps capacity
+        tx_offset = 0;
+    }
+
+    void send_output()
+    {
+        flush();
+
+        if(closed || !connected())
+            return;
+
+        // robot does not read: commands are stale anyway
+        if(tx.size() - tx_offset > MAX_OUTPUT_BACKLOG) {
+            lost();
+            return;
+        }
+
+        update_events();
+    }
+
+    // serialize command at the end of output queue
+    template <uint8_t CmdNum, typename T>
+    void queue(const T& arg)
+    {
+        size_t offset = tx.size();
+        binary_ostream os(tx, offset);
+
+        try {
+            write_p2_at_cmd<CmdNum>(os, arg);
+        }
+        catch(...) {
+            tx.resize(offset);
+            throw;
+        }
+
+        tx.resize(offset + os.pos());
+    }
+
+    template <uint8_t CmdNum>
+    void queue() { queue<CmdNum>(std::tuple<>()); }
+
+    // SYNC0 again, open connection is closed first
+    void restart()
+    {
+        ++stat.restarts;
+        if(state == RUNNING)
+            queue<2>(); // CLOSE
+        start_sync();
+        send_output();
+    }
+
+    void start_sync()
+    {
+        state = SYNC0;
+        sip_interval.reset();
+        deadline = clock::now() + us(timeouts.reply);
+        queue<0>();
+    }
+
+    void on_tick()
+    {
+        if(closed || !connected())
+            return;
+
+        auto now = clock::now();
+
+        if(now >= deadline) {
+            if(connecting)
+                lost();
+            else
+                restart();
+            return;
+        }
+
+        if(state == RUNNING && now - last_pulse >= us(timeouts.pulse)) {
+            last_pulse = now;
+            queue<0>(); // PULSE
+            send_output();
+        }
+    }
+
+    // body: data and check sum
+    void on_packet(const char* body, size_t size)
+    {
+        uint8_t first = uint8_t(body[0]);
+        auto now = clock::now();
+
+        switch(state) {
+        case SYNC0:
+        case SYNC1:
+            if(first != state) // echo of other command
+                return;
+
+            state = state_t(state + 1);
+            deadline = now + us(timeouts.reply);
+            if(state == SYNC1)
+                queue<1>();
+            else
+                queue<2>();
+            break;
+
+        case SYNC2:
+            if(first != SYNC2) // robot name, class and subclass follow
+                return;
+
+            state = RUNNING;
+            backoff = timeouts.retry;
+            deadline = now + us(timeouts.sip);
+            last_pulse = now;
+            queue<1>();            // start controller
+            queue<4>(uint16_t(1)); // start motors
+            break;
+
+        case RUNNING:
+            if((first & 0xF0) != 0x30) // not a SIP
+                return;
+
+            try {
+                sip_view view(body, size);
+                deadline = now + us(timeouts.sip);
+                sip_interval.tick();
+                if(on_sip)
+                    on_sip(view);
+            }
+            catch(const std::out_of_range&) { // inconsistent sonar count
+                ++stat.bad;
+            }
+            break;
+        }
+    }
+
+    // frame all complete packets in rx
+    void parse()
+    {
+        size_t offset =
+        scan_packets
+        (
+            rx.data(),
+            rx.size(),
+            [this](const char* body, size_t size)
+            {
+                ++stat.packets;
+                this->on_packet(body, size);
+            },
+            stat.skipped,
+            stat.bad
+        );
+
+        rx.erase(rx.begin(), rx.begin() + offset);
+    }
+
+    void on_readable()
+    {
+        while(true) {
+            size_t old = rx.size();
+            rx.resize(old + READ_CHUNK); // receive arena, keeps capacity
+
+            int n = socket.read_some(rx.data() + old, READ_CHUNK);
+            rx.resize(old + (n > 0 ? n : 0));
+
+            if(n == 0 || (n < 0 && !would_block())) {
+                lost();
+                return;
+            }
+
+            if(n < 0)
+                break;
+        }
+
+        parse();
+        if(!closed && connected())
+            send_output(); // replies of this read in one write
+    }
+
+    void on_event(uint32_t ev)
+    {
+        if(ev & reactor::ERROR_EVENT) {
+            lost();
+            return;
+        }
+
+        if(connecting) {
+            if(connect_error(socket.handle()) != 0)
+                lost();
+            else
+                on_connected();
+            return;
+        }
+
+        if(ev & reactor::READ_EVENT)
+            on_readable();
+
+        if(!closed && connected() && (ev & reactor::WRITE_EVENT))
+            send_output();
+    }
+public:
+    // socket is connected to robot, handshake starts immediately,
+    // link loss closes driver
+    driver
+    (
+        reactor& r,
+        const tcp_socket& s,
+        const sip_handler_t& f,
+        const link_timeouts& t = link_timeouts()
+    ):
+        loop(r),
+        socket(s),
+        on_sip(f),
+        timeouts(t),
+        ip(0),
+        port(0),
+        state(SYNC0),
+        closed(false),
+        stat(),
+        connecting(false),
+        retry_pending(false),
+        backoff(t.retry),
+        tx_offset(0),
+        events(reactor::READ_EVENT),
+        sip_interval(metrics::SIP_INTERVAL),
+        self(std::make_shared<driver*>(this))
+    {
+        set_nonblocking(socket.handle());
+        socket.set_no_delay();
+
+        loop.add(socket.handle(), events, [this](uint32_t ev) { this->on_event(ev); });
+        tick_timer = loop.add_periodic_timer(timeouts.tick, [this]() { this->on_tick(); });
+
+        start_sync();
+        send_output();
+    }
+
+    // connects from reactor thread: robot may be not started yet,
+    // failed connect and link loss are retried with backoff
+    driver
+    (
+        reactor& r,
+        uint32_t robot_ip,
+        uint16_t robot_port,
+        const sip_handler_t& f,
+        const link_timeouts& t = link_timeouts()
+    ):
+        loop(r),
+        socket(-1),
+        on_sip(f),
+        timeouts(t),
+        ip(robot_ip),
+        port(robot_port),
+        state(SYNC0),
+        closed(false),
+        stat(),
+        connecting(false),
+        retry_pending(false),
+        backoff(t.retry),
+        tx_offset(0),
+        events(0),
+        sip_interval(metrics::SIP_INTERVAL),
+        self(std::make_shared<driver*>(this))
+    {
+        tick_timer = loop.add_periodic_timer(timeouts.tick, [this]() { this->on_tick(); });
+
+        std::weak_ptr<driver*> w = self;
+        loop.post
+        (
+            [w]()
+            {
+                auto d = w.lock();
+                if(d && !(*d)->closed)
+                    (*d)->connect();
+            }
+        );
+    }
+
+    driver(const driver&) = delete;
+    driver& operator=(const driver&) = delete;
+
+    ~driver() { close(); }
+
+    // thread safe: command is sent from reactor thread,
+    // commands before handshake end are dropped
+    template <uint8_t CmdNum, typename T>
+    void command(const T& arg)
+    {
+        std::weak_ptr<driver*> w = self;
+        loop.post
+        (
+            [w, arg]()
+            {
+                auto d = w.lock();
+                if(!d || (*d)->closed || (*d)->state != RUNNING)
+                    return;
+
+                (*d)->queue<CmdNum>(arg);
+                (*d)->send_output();
+            }
+        );
+    }
+
+    template <uint8_t CmdNum>
+    void command() { command<CmdNum>(std::tuple<>()); }
+
+    // any thread
+    state_t get_state() const { return state; }
+    bool is_closed() const { return closed; }
+
+    // reactor thread, or after its loop is stopped
+    const counters& get_counters() const { return stat; }
+
+    // link is not used any more: socket is closed, no reconnect;
+    // reactor thread, or after its loop is stopped
+    void close()
+    {
+        if(closed)
+            return;
+
+        closed = true;
+        loop.cancel_timer(tick_timer);
+        if(retry_pending)
+            loop.cancel_timer(retry_timer);
+
+        if(connected()) {
+            loop.remove(socket.handle());
+            socket.close();
+            socket = tcp_socket(-1);
+        }
+    }
+};
+
+}}
+
+#endif //__P2AT_DRIVER__
@@ -0,0 +1,286 @@
+#ifndef __P2AT_GATEWAY__
+#define __P2AT_GATEWAY__
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+
+#include "device.h"
+#include "multi_server.h"
+#include "p2at_driver.h"
+
+namespace robot
+{
+namespace p2at
+{
+
+///////////////////////////////////////////////////////////
+//
+//                  multi-robot gateway
+//
+///////////////////////////////////////////////////////////
+
+struct robot_address
+{
+    uint32_t ip;
+    uint16_t port;
+};
+
+// robot i is (MOTION_CONTROL, i) and (SENSOR_1D, i) functions of one
+// server; robot links are sharded across worker threads, one reactor
+// per worker, workers are pinned to cores; robot state regs are set on
+// server thread from last SIP snapshot
+
+class gateway
+{
+public:
+    enum { SONARS = 16 };
+
+    using flag = non_dimentional<uint8_t>;
+    using sonar_ranges = std::array<mm, SONARS>;
+private:
+    // regs of one robot and its link; posted publications hold
+    // a weak reference, unit may be destroyed before they run
+    class unit : public std::enable_shared_from_this<unit>
+    {
+    public:
+        // move control, written by clients
+        reg<mm_per_second , READ_FLAG | WRITE_FLAG> preseted_vel;
+        reg<deg_per_second, READ_FLAG | WRITE_FLAG> preseted_rvel;
+        reg<flag, READ_FLAG | WRITE_FLAG> linear_move_flag;
+        reg<flag, READ_FLAG | WRITE_FLAG> angular_move_flag;
+
+        // robot state from SIP
+        reg<mm, READ_FLAG> x_pos;
+        reg<mm, READ_FLAG> y_pos;
+        reg<mm_per_second, READ_FLAG> vel;
+        reg<sonar_ranges, READ_FLAG> sonars;
+
+        std::unique_ptr<driver> link;
+    private:
+        // robot state of last SIP
+        struct sip_state
+        {
+            mm x;
+            mm y;
+            mm_per_second vel;
+            sonar_ranges sonars;
+        };
+
+        shared_value<sip_state> latest;
+        sonar_ranges ranges; // worker thread: readings of SIPs merged
+
+        reactor* server_loop;
+        std::atomic<bool> publish_posted;
+
+        // server thread
+        void publish()
+        {
+            publish_posted = false;
+
+            sip_state s = latest.load();
+            x_pos.set(s.x);
+            y_pos.set(s.y);
+            vel.set(s.vel);
+            sonars.set(s.sonars);
+        }
+    public:
+        unit():
+            ranges(),
+            server_loop(0),
+            publish_posted(false)
+        {
+            linear_move_flag.set(flag(0));
+            angular_move_flag.set(flag(0));
+        }
+
+        void bind(function_base& move, function_base& sensor, reactor& srv_loop)
+        {
+            server_loop = &srv_loop;
+
+            move = move_control_function();
+            move[0x00] = x_pos.make_parameter(0x00);
+            move[0x01] = y_pos.make_parameter(0x01);
+            move[0x06] = vel.make_parameter(0x06);
+            move[0x0E] = preseted_vel.make_parameter(0x0E);
+            move[0x0F] = preseted_rvel.make_parameter(0x0F);
+            move[0x18] = linear_move_flag.make_parameter(0x18);
+            move[0x19] = angular_move_flag.make_parameter(0x19);
+
+            sensor = sensor_1D_function();
+            sensor[0x0A] = sonars.make_parameter(0x0A); // current ranges
+
+            auto linear_move =
+            [this]()
+            {
+                int16_t v =
+                linear_move_flag.get().get_value() * preseted_vel.get().get_value();
+                link->command<11>(v);
+            };
+
+            auto angular_move =
+            [this]()
+            {
+                int16_t rv =
+                angular_move_flag.get().get_value() * preseted_rvel.get().get_value();
+                link->command<21>(rv);
+            };
+
+            preseted_vel.add_action(linear_move);
+            linear_move_flag.add_action(linear_move);
+
+            preseted_rvel.add_action(angular_move);
+            angular_move_flag.add_action(angular_move);
+        }
+
+        // worker thread: one publication is pending at most,
+        // it takes the last snapshot
+        void on_sip(const sip_view& v)
+        {
+            for(auto it = v.sonars_begin(); it != v.sonars_end(); ++it) {
+                sonar_reading r = *it;
+                if(robot::get<sonar_number>(r) < SONARS)
+                    ranges[robot::get<sonar_number>(r)] = robot::get<sonar_range>(r);
+            }
+
+            sip_state s;
+            s.x = v.x_pos();
+            s.y = v.y_pos();
+            s.vel = mm_per_second((v.l_vel().get_value() + v.r_vel().get_value()) / 2);
+            s.sonars = ranges;
+            latest.store(s);
+
+            if(publish_posted.exchange(true))
+                return;
+
+            std::weak_ptr<unit> w = shared_from_this();
+            server_loop->post
+            (
+                [w]()
+                {
+                    auto u = w.lock();
+                    if(u)
+                        u->publish();
+                }
+            );
+        }
+    };
+
+    struct worker
+    {
+        reactor loop;
+        std::thread thread;
+    };
+
+    std::vector<std::shared_ptr<unit>> units;
+    std::vector<std::unique_ptr<worker>> workers;
+    bool running;
+
+    // failure is not fatal: thread runs unpinned
+    static void pin(std::thread& t, size_t core)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(core, &set);
+        pthread_setaffinity_np(t.native_handle(), sizeof(set), &set);
+    }
+public:
+    // functions are bound before server run, robots are connected by
+    // workers and reconnected after link loss; worker_count 0 - one
+    // worker per core
+    gateway
+    (
+        multi_server& srv,
+        const std::vector<robot_address>& robots,
+        size_t worker_count = 0,
+        const link_timeouts& t = link_timeouts()
+    ):
+        running(false)
+    {
+        size_t cores = std::max(std::thread::hardware_concurrency(), 1u);
+
+        if(worker_count == 0)
+            worker_count = cores;
+        worker_count = std::max<size_t>(std::min(worker_count, robots.size()), 1);
+
+        for(size_t i = 0; i < worker_count; i++)
+            workers.emplace_back(new worker());
+
+        for(size_t i = 0; i < robots.size(); i++) {
+            units.push_back(std::make_shared<unit>());
+            unit& u = *units.back();
+
+            u.bind
+            (
+                srv.get_function_ref(uint16_t(FunctionCodes::MOTION_CONTROL), i),
+                srv.get_function_ref(uint16_t(FunctionCodes::SENSOR_1D), i),
+                srv.get_reactor()
+            );
+
+            // loops do not run yet: drivers are added from this thread
+            u.link.reset
+            (
+                new driver
+                (
+                    workers[i % worker_count]->loop,
+                    robots[i].ip,
+                    robots[i].port,
+                    [&u](const sip_view& v) { u.on_sip(v); },
+                    t
+                )
+            );
+        }
+    }
+
+    gateway(const gateway&) = delete;
+    gateway& operator=(const gateway&) = delete;
+
+    ~gateway()
+    {
+        stop();
+        units.clear(); // drivers leave their loops before workers
+    }
+
+    void start()
+    {
+        if(running)
+            return;
+
+        running = true;
+
+        size_t cores = std::max(std::thread::hardware_concurrency(), 1u);
+
+        for(size_t i = 0; i < workers.size(); i++) {
+            reactor& loop = workers[i]->loop;
+            workers[i]->thread = std::thread([&loop]() { loop.run(); });
+            pin(workers[i]->thread, i % cores);
+        }
+    }
+
+    void stop()
+    {
+        if(!running)
+            return;
+
+        running = false;
+
+        for(auto& w : workers) {
+            reactor& loop = w->loop;
+            loop.post([&loop]() { loop.stop(); });
+            w->thread.join();
+        }
+    }
+
+    size_t robot_count() const { return units.size(); }
+    size_t worker_count() const { return workers.size(); }
+
+    // link of robot i, its state is changed by worker thread
+    const driver& get_link(size_t i) const { return *units[i]->link; }
+};
+
+}}
+
+#endif //__P2AT_GATEWAY__
@@ -0,0 +1,419 @@
+#ifndef __P2AT_SIM__
+#define __P2AT_SIM__
+
+#include <cmath>
+#include <vector>
+
+#include "reactor.h"
+#include "pioneer_2at.h"
+
+namespace robot
+{
+namespace p2at
+{
+
+///////////////////////////////////////////////////////////
+//
+//                  P2AT simulator
+//
+///////////////////////////////////////////////////////////
+
+struct sim_config
+{
+    uint8_t sonars;    // readings per SIP
+    uint32_t sip_rate; // SIPs per second
+    uint64_t watchdog; // microseconds without commands before stop, 0 - off
+
+    sim_config
+    (
+        uint8_t s = 16,
+        uint32_t r = 10,
+        uint64_t w = 2000000
+    ):
+        sonars(s),
+        sip_rate(r),
+        watchdog(w)
+    {}
+};
+
+// robot stand-in on reactor: one client at a time, SYNC0/1/2 echoes,
+// OPEN/CLOSE, ENABLE, VEL (11) and RVEL (21), SIP stream with odometry
+// from commanded velocities; many simulators can share one reactor
+
+class simulator
+{
+public:
+    enum state_t : uint8_t { SYNC0, SYNC1, SYNC2, READY, OPEN };
+
+    struct counters
+    {
+        size_t sips;     // sent
+        size_t commands; // accepted after handshake
+        size_t bad;      // damaged packets
+    };
+private:
+    using clock = timer_wheel::clock;
+
+    enum { READ_CHUNK = 4096 };
+    enum { MAX_SONARS = 64 };        // SIP fits into one packet
+    enum { MAX_BURST = 64 };         // SIPs per tick after stall
+    enum { AXLE_WIDTH = 400 };       // mm
+    enum { ANGLE_UNITS = 4096 };     // th_pos units per turn
+
+    reactor& loop;
+    tcp_listener listener;
+    sim_config config;
+
+    tcp_socket socket;
+    state_t state;
+    counters stat;
+    size_t skipped;
+
+    std::vector<char> rx;
+    std::vector<char> tx;
+    size_t tx_offset;
+    uint32_t events;
+
+    reactor::timer_id tick_timer;
+    clock::time_point opened;
+    clock::time_point last_tick;
+    clock::time_point last_cmd;
+    uint64_t due_sent; // SIPs since OPEN
+
+    // odometry
+    bool motors;
+    int16_t vel;  // mm/s
+    int16_t rvel; // deg/s
+    double x, y, th; // mm, mm, rad
+
+    sip data; // reused: no allocations per SIP
+
+    bool connected() const { return socket.handle() >= 0; }
+
+    void update_events()
+    {
+        uint32_t ev = reactor::READ_EVENT;
+        if(tx_offset != tx.size())
+            ev |= reactor::WRITE_EVENT;
+
+        if(ev != events) {
+            loop.modify(socket.handle(), ev);
+            events = ev;
+        }
+    }
+
+    void send_output()
+    {
+        while(tx_offset != tx.size()) {
+            int n = socket.write_some(tx.data() + tx_offset, tx.size() - tx_offset);
+
+            if(n < 0) {
+                if(!would_block())
+                    drop();
+                else
+                    update_events();
+                return;
+            }
+
+            tx_offset += n;
+        }
+
+        tx.clear(); // keeps capacity
+        tx_offset = 0;
+        update_events();
+    }
+
+    template <typename T>
+    void queue(const T& t)
+    {
+        size_t offset = tx.size();
+        binary_ostream os(tx, offset);
+        write_p2_at_msg(os, t);
+        tx.resize(offset + os.pos());
+    }
+
+    template <uint8_t CmdNum>
+    void echo() { queue(p2_at_cmd<CmdNum>()); }
+
+    void stop_motion()
+    {
+        vel = 0;
+        rvel = 0;
+    }
+
+    void drop()
+    {
+        loop.remove(socket.handle());
+        socket.close();
+        socket = tcp_socket(-1);
+
+        state = SYNC0;
+        stop_motion();
+        rx.clear();
+        tx.clear();
+        tx_offset = 0;
+    }
+
+    void on_accept()
+    {
+        while(true) {
+            tcp_socket s = listener.accept_connection();
+            if(s.handle() < 0)
+                return;
+
+            if(connected()) { // robot has one serial port
+                s.close();
+                continue;
+            }
+
+            socket = s;
+            socket.set_no_delay();
+            state = SYNC0;
+            events = reactor::READ_EVENT;
+
+            loop.add(socket.handle(), events, [this](uint32_t ev) { this->on_event(ev); });
+        }
+    }
+
+    // argument of VEL, RVEL, ENABLE: type byte, 2 bytes little endian
+    static bool arg(const char* body, size_t size, int16_t& v)
+    {
+        if(size < 4 + 2)
+            return false;
+        v = robot::details::load_le<int16_t>(body + 2);
+        return true;
+    }
+
+    void on_packet(const char* body, size_t size)
+    {
+        uint8_t cmd = uint8_t(body[0]);
+        int16_t v = 0;
+
+        if(state < READY) { // SYNC0 restarts handshake from any step
+            if(cmd == 0) {
+                echo<0>();
+                state = SYNC1;
+            }
+            else if(cmd == 1 && state == SYNC1) {
+                echo<1>();
+                state = SYNC2;
+            }
+            else if(cmd == 2 && state == SYNC2) {
+                // SYNC2 echo with robot name, class and subclass
+                const char id[] = "\x02" "sim\0" "Pioneer\0" "p2at";
+                std::array<char, sizeof(id)> reply;
+                std::copy(id, id + sizeof(id), reply.begin());
+                queue(reply);
+                state = READY;
+            }
+            return;
+        }
+
+        ++stat.commands;
+        last_cmd = clock::now();
+
+        switch(cmd) {
+        case 0: // PULSE
+            break;
+        case 1: // OPEN
+            if(state != OPEN) {
+                state = OPEN;
+                opened = last_tick = last_cmd;
+                due_sent = 0;
+            }
+            break;
+        case 2: // CLOSE
+            state = SYNC0;
+            motors = false;
+            stop_motion();
+            break;
+        case 4: // ENABLE
+            if(arg(body, size, v))
+                motors = v != 0;
+            break;
+        case 11: // VEL
+            if(arg(body, size, v))
+                vel = v;
+            break;
+        case 21: // RVEL
+            if(arg(body, size, v))
+                rvel = v;
+            break;
+        default:
+            break;
+        }
+    }
+
+    void on_readable()
+    {
+        while(true) {
+            size_t old = rx.size();
+            rx.resize(old + READ_CHUNK);
+
+            int n = socket.read_some(rx.data() + old, READ_CHUNK);
+            rx.resize(old + (n > 0 ? n : 0));
+
+            if(n == 0 || (n < 0 && !would_block())) {
+                drop();
+                return;
+            }
+
+            if(n < 0)
+                break;
+        }
+
+        size_t offset =
+        scan_packets
+        (
+            rx.data(),
+            rx.size(),
+            [this](const char* body, size_t size) { this->on_packet(body, size); },
+            skipped,
+            stat.bad
+        );
+        rx.erase(rx.begin(), rx.begin() + offset);
+
+        send_output();
+    }
+
+    void on_event(uint32_t ev)
+    {
+        if(ev & reactor::ERROR_EVENT) {
+            drop();
+            return;
+        }
+
+        if(ev & reactor::READ_EVENT)
+            on_readable();
+
+        if(connected() && (ev & reactor::WRITE_EVENT))
+            send_output();
+    }
+
+    void move(clock::time_point now)
+    {
+        double dt = std::chrono::duration<double>(now - last_tick).count();
+        last_tick = now;
+
+        if(config.watchdog && now - last_cmd > std::chrono::microseconds(config.watchdog))
+            stop_motion();
+
+        if(!motors)
+            return;
+
+        const double pi = 3.14159265358979323846;
+
+        th += rvel * pi / 180 * dt;
+        x += vel * std::cos(th) * dt;
+        y += vel * std::sin(th) * dt;
+    }
+
+    void fill_sip()
+    {
+        const double pi = 3.14159265358979323846;
+        bool moving = motors && (vel != 0 || rvel != 0);
+
+        int16_t turn = int16_t(rvel * pi / 180 * AXLE_WIDTH / 2);
+
+        robot::get<status_key>(data) = moving ? 0x33 : 0x32;
+        robot::get<x_pos_key>(data) = uint16_t(int64_t(x));
+        robot::get<y_pos_key>(data) = uint16_t(int64_t(y));
+        robot::get<th_pos_key>(data) =
+        int16_t(int64_t(std::floor(th / (2 * pi) * ANGLE_UNITS)) & (ANGLE_UNITS - 1));
+        robot::get<l_vel_key>(data) = motors ? int16_t(vel - turn) : 0;
+        robot::get<r_vel_key>(data) = motors ? int16_t(vel + turn) : 0;
+        robot::get<battery>(data) = 130; // 13.0 V
+        robot::get<timer>(data) = uint16_t(due_sent);
+
+        // ranges change with position: client sees fresh readings
+        auto& s = robot::get<sonar_measurements>(data);
+        for(size_t i = 0; i < s.size(); i++)
+            robot::get<sonar_range>(s[i]) = mm(int16_t(1000 + 100 * i + (int64_t(x) & 0xFF)));
+    }
+
+    void on_tick()
+    {
+        if(!connected() || state != OPEN)
+            return;
+
+        auto now = clock::now();
+        move(now);
+
+        // rate above timer resolution: several SIPs per tick
+        uint64_t due =
+        std::chrono::duration_cast<std::chrono::microseconds>(now - opened).count() *
+        config.sip_rate / 1000000;
+
+        if(due - due_sent > MAX_BURST) // client or loop stalled: skip
+            due_sent = due - MAX_BURST;
+
+        for(; due_sent < due; due_sent++) {
+            fill_sip();
+            queue(data);
+            ++stat.sips;
+        }
+
+        send_output();
+    }
+public:
+    simulator
+    (
+        reactor& r,
+        uint32_t ip,
+        uint16_t port,
+        const sim_config& c = sim_config()
+    ):
+        loop(r),
+        listener(ip, port),
+        config(c),
+        socket(-1),
+        state(SYNC0),
+        stat(),
+        skipped(0),
+        tx_offset(0),
+        events(reactor::READ_EVENT),
+        due_sent(0),
+        motors(false),
+        vel(0),
+        rvel(0),
+        x(0),
+        y(0),
+        th(0)
+    {
+        config.sonars = std::min<uint8_t>(config.sonars, MAX_SONARS);
+        config.sip_rate = std::max<uint32_t>(config.sip_rate, 1);
+
+        auto& s = robot::get<sonar_measurements>(data);
+        s.resize(config.sonars);
+        for(size_t i = 0; i < s.size(); i++)
+            robot::get<sonar_number>(s[i]) = i;
+
+        // timer resolution is 1 ms
+        uint64_t period = std::max<uint64_t>(1000000 / config.sip_rate, 1000);
+
+        loop.add(listener.handle(), reactor::READ_EVENT, [this](uint32_t) { this->on_accept(); });
+        tick_timer = loop.add_periodic_timer(period, [this]() { this->on_tick(); });
+    }
+
+    simulator(const simulator&) = delete;
+    simulator& operator=(const simulator&) = delete;
+
+    ~simulator()
+    {
+        loop.cancel_timer(tick_timer);
+        loop.remove(listener.handle());
+        if(connected())
+            drop();
+    }
+
+    state_t get_state() const { return state; }
+    const counters& get_counters() const { return stat; }
+
+    bool is_moving() const { return motors && (vel != 0 || rvel != 0); }
+    int16_t get_vel() const { return vel; }
+    int16_t get_rvel() const { return rvel; }
+};
+
+}}
+
+#endif //__P2AT_SIM__
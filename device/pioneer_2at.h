@@ -40,22 +40,119 @@ std::tuple
     >>
 >;
 
+// p2_at_msg head: 0xFA 0xFB, body size (data and check sum)
+constexpr size_t HEAD_SIZE = 3;
+
+inline bool check_head(const char* p)
+{
+    return uint8_t(p[0]) == 0xFA && uint8_t(p[1]) == 0xFB;
+}
+
+// sum of big endian 16 bit words, odd last byte is xored,
+// result is byte swapped to be written as little endian uint16_t
+
+namespace details
+{
+
+// bytes of 8 byte word to 16 bit lanes: even bytes (high halves
+// of big endian words) and odd bytes (low halves)
+constexpr uint64_t LANE_MASK = 0x00FF00FF00FF00FFull;
+
+// sum of four 16 bit lanes
+inline uint32_t lanes_sum(uint64_t x)
+{
+    x = (x & 0x0000FFFF0000FFFFull) + ((x >> 16) & 0x0000FFFF0000FFFFull);
+    return uint32_t(x) + uint32_t(x >> 32);
+}
+
+}
+
 inline uint16_t chck_sum_calc(const char *ptr, uint16_t n)
 {
-    uint16_t c = 0;
-    const uint8_t *p =  (const uint8_t*)ptr;
+    using robot::details::load_le;
+
+    uint32_t hi = 0; // sum of high bytes
+    uint32_t lo = 0; // sum of low bytes
+
+    // 16 bytes per step, 128 steps: 256 bytes per lane, no overflow
+    while(n >= 16) {
+        size_t steps = std::min<size_t>(n / 16, 128);
+
+        uint64_t h = 0, l = 0;
+
+        for(size_t i = 0; i < steps; i++, ptr += 16) {
+            uint64_t w0 = load_le<uint64_t>(ptr);
+            uint64_t w1 = load_le<uint64_t>(ptr + 8);
+
+            h += (w0 & details::LANE_MASK) + (w1 & details::LANE_MASK);
+            l += ((w0 >> 8) & details::LANE_MASK) + ((w1 >> 8) & details::LANE_MASK);
+        }
+
+        hi += details::lanes_sum(h);
+        lo += details::lanes_sum(l);
+        n -= steps * 16;
+    }
+
+    const uint8_t *p = (const uint8_t*)ptr;
 
-    while (n > 1) {
-        c += (*(p)<<8) | *(p+1);
-        n -= 2;
-        p += 2;
+    for(; n > 1; n -= 2, p += 2) {
+        hi += p[0];
+        lo += p[1];
     }
 
+    uint16_t c = (hi << 8) + lo;
+
     if (n > 0)
         c ^= (uint16_t)*(p++);
     return ((c % 0x100) << 8) | (c / 0x100);
 }
 
+// frames packets in received data: bytes before 0xFA 0xFB head are
+// skipped, false head or damaged packet is skipped from its next byte,
+// so one glitch costs one packet; f(body, size) is called for valid
+// packets (data and check sum), returns number of consumed bytes
+template <typename F>
+inline size_t scan_packets
+(
+    const char* data,
+    size_t n,
+    const F& f,
+    size_t& skipped,
+    size_t& bad
+)
+{
+    using robot::details::load_le;
+
+    size_t offset = 0;
+
+    while(true) {
+        while(n - offset >= 2 && !check_head(data + offset)) {
+            ++offset;
+            ++skipped;
+        }
+
+        if(n - offset < HEAD_SIZE)
+            break;
+
+        size_t size = uint8_t(data[offset + HEAD_SIZE - 1]);
+        if(n - offset < HEAD_SIZE + size)
+            break;
+
+        const char* body = data + offset + HEAD_SIZE;
+
+        if(size < 3 || load_le<uint16_t>(body + size - 2) != chck_sum_calc(body, size - 2)) {
+            ++offset;
+            ++bad;
+            continue;
+        }
+
+        offset += HEAD_SIZE + size;
+        f(body, size);
+    }
+
+    return offset;
+}
+
 struct cmd_arg;
 
 template <uint8_t CmdNum, typename T = std::tuple<>>
@@ -89,9 +186,14 @@ inline p2_at_msg<p2_at_cmd<CmdNum, T>> make_p2_at_cmd(const T& p)
     auto& arg       = get<cmd_arg>(cmd);
     auto& check_sum = get<msg_chck_sum>(body);
 
-    size = calc_size(body);
     arg  = p;
-    check_sum = chck_sum_calc(make_buffer(cmd).data, size - calc_size(check_sum));
+    size = calc_size(body); // compile time for constant size args
+
+    // body size fits uint8_t: no heap buffer for check sum
+    char data[256];
+    binary_ostream os(data, sizeof(data));
+    os << cmd;
+    check_sum = chck_sum_calc(data, os.pos());
 
     return res;
 }
@@ -102,6 +204,40 @@ inline p2_at_msg<p2_at_cmd<CmdNum>> make_p2_at_cmd()
     return make_p2_at_cmd<CmdNum>(std::tuple<>());
 }
 
+// packet serialized in one pass, e.g. into connection arena:
+// size and check sum are computed over written data
+template <typename T>
+inline void write_p2_at_msg(binary_ostream& os, const T& data)
+{
+    size_t start = os.pos();
+    size_t body = start + HEAD_SIZE;
+
+    os << at_key<msg_head, p2_at_msg<T>>();
+    os << data;
+
+    size_t size = os.pos() - body;
+    if(size + 2 > 0xFF)
+        throw std::out_of_range("error: p2at packet is too long");
+
+    os << chck_sum_calc(os.written(body), size);
+    os.patch(start + HEAD_SIZE - 1, uint8_t(size + 2));
+}
+
+template <uint8_t CmdNum, typename T>
+inline void write_p2_at_cmd(binary_ostream& os, const T& p)
+{
+    p2_at_cmd<CmdNum, T> cmd;
+    get<cmd_arg>(cmd) = p;
+
+    write_p2_at_msg(os, cmd);
+}
+
+template <uint8_t CmdNum>
+inline void write_p2_at_cmd(binary_ostream& os)
+{
+    write_p2_at_cmd<CmdNum>(os, std::tuple<>());
+}
+
 struct status_key;
 
 struct x_pos_key;
@@ -164,6 +300,153 @@ std::tuple
     pair<digout, uint8_t>
 >;
 
+///////////////////////////////////////////////////////////
+//
+//                  SIP view
+//
+///////////////////////////////////////////////////////////
+
+using sonar_reading = at_key<sonar_measurements, sip>::value_type;
+
+namespace details
+{
+
+// serialized size of sip elements [From, To), all constant size
+template <size_t From, size_t To, bool = (From == To)>
+struct sip_span_size : std::integral_constant<size_t, 0> {};
+
+template <size_t From, size_t To>
+struct sip_span_size<From, To, false> :
+std::integral_constant
+<
+    size_t,
+    static_size<typename std::tuple_element<From, sip>::type>::value +
+    sip_span_size<From + 1, To>::value
+>
+{};
+
+template <typename Key, typename T>
+struct tuple_key_index;
+
+template <typename Key, typename ...T>
+struct tuple_key_index<Key, std::tuple<T...>> : robot::details::key_index<Key, T...> {};
+
+template <typename Key>
+using sip_index = tuple_key_index<Key, sip>;
+
+constexpr size_t SONARS = sip_index<sonar_measurements>::value;
+constexpr size_t SIP_FIELDS = std::tuple_size<sip>::value;
+
+constexpr size_t SONARS_OFFSET = sip_span_size<0, SONARS>::value + 1; // + count
+constexpr size_t SONAR_SIZE = static_size<sonar_reading>::value;
+constexpr size_t TAIL_SIZE = sip_span_size<SONARS + 1, SIP_FIELDS>::value;
+
+}
+
+// SIP read in place from received body (data and check sum, msg_size bytes):
+// check sum and layout are validated once, fields are loaded on access,
+// valid while body memory is
+class sip_view
+{
+    const char* data;
+    uint8_t count; // sonar readings
+
+    const char* tail() const
+    {
+        return data + details::SONARS_OFFSET + count * details::SONAR_SIZE;
+    }
+
+    template <typename Key>
+    using if_head =
+    typename
+    std::enable_if
+    <
+        (details::sip_index<Key>::value < details::SONARS),
+        at_key<Key, sip>
+    >::type;
+
+    template <typename Key>
+    using if_tail =
+    typename
+    std::enable_if
+    <
+        (details::sip_index<Key>::value > details::SONARS),
+        at_key<Key, sip>
+    >::type;
+public:
+    // sonar readings in place: (sonar_number, sonar_range) tuples
+    class sonar_iterator
+    {
+        const char* p;
+    public:
+        sonar_iterator(const char* ptr): p(ptr) {}
+
+        sonar_reading operator*() const
+        {
+            sonar_reading r;
+            robot::get<sonar_number>(r) = uint8_t(*p);
+            robot::get<sonar_range>(r) = mm(robot::details::load_le<int16_t>(p + 1));
+            return r;
+        }
+
+        sonar_iterator& operator++()
+        {
+            p += details::SONAR_SIZE;
+            return *this;
+        }
+
+        bool operator==(const sonar_iterator& i) const { return p == i.p; }
+        bool operator!=(const sonar_iterator& i) const { return p != i.p; }
+    };
+
+    sip_view(const char* body, size_t size)
+    {
+        using namespace details;
+
+        if(size < SONARS_OFFSET + TAIL_SIZE + 2)
+            throw std::out_of_range("error: sip is too short");
+
+        size -= 2; // check sum
+        if(robot::details::load_le<uint16_t>(body + size) != chck_sum_calc(body, size))
+            throw std::logic_error("error: sip check sum mismatch");
+
+        data = body;
+        count = uint8_t(data[SONARS_OFFSET - 1]);
+
+        // newer firmware may append fields
+        if(size < SONARS_OFFSET + count * SONAR_SIZE + TAIL_SIZE)
+            throw std::out_of_range("error: sip is too short");
+    }
+
+    // fixed fields before and after sonar readings
+    template <typename Key>
+    if_head<Key> get() const
+    {
+        constexpr size_t offset = details::sip_span_size<0, details::sip_index<Key>::value>::value;
+        return robot::details::load_le<at_key<Key, sip>>(data + offset);
+    }
+
+    template <typename Key>
+    if_tail<Key> get() const
+    {
+        constexpr size_t offset =
+        details::sip_span_size<details::SONARS + 1, details::sip_index<Key>::value>::value;
+        return robot::details::load_le<at_key<Key, sip>>(tail() + offset);
+    }
+
+    mm x_pos() const { return mm(int16_t(get<x_pos_key>())); }
+    mm y_pos() const { return mm(int16_t(get<y_pos_key>())); }
+    int16_t th_pos() const { return get<th_pos_key>(); } // robot angular units
+
+    mm_per_second l_vel() const { return mm_per_second(get<l_vel_key>()); }
+    mm_per_second r_vel() const { return mm_per_second(get<r_vel_key>()); }
+
+    size_t sonar_count() const { return count; }
+
+    sonar_iterator sonars_begin() const { return sonar_iterator(data + details::SONARS_OFFSET); }
+    sonar_iterator sonars_end() const { return sonar_iterator(tail()); }
+};
+
 }}
 
 #endif //__PIONEER_2AT__
@@ -0,0 +1,38 @@
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include "tcp.h"
+#include "device/p2at_sim.h"
+
+// p2at_sim [port] [count] [sip_rate] [sonars]: count robots on
+// consecutive ports, stand-in for MobileSim in load tests
+int main(int argc, char** argv)
+{
+    using namespace robot;
+
+    uint16_t port = argc > 1 ? atoi(argv[1]) : 8101;
+    size_t count = argc > 2 ? atoi(argv[2]) : 1;
+    uint32_t rate = argc > 3 ? atoi(argv[3]) : 10;
+    uint8_t sonars = argc > 4 ? atoi(argv[4]) : 16;
+
+    reactor loop;
+
+    std::vector<std::unique_ptr<p2at::simulator>> robots;
+    for(size_t i = 0; i < count; i++)
+        robots.emplace_back
+        (
+            new p2at::simulator
+            (
+                loop,
+                INADDR_ANY,
+                port + i,
+                p2at::sim_config(sonars, rate)
+            )
+        );
+
+    std::cout << count << " robots on ports " << port << "-" << port + count - 1 << std::endl;
+
+    loop.run();
+
+    return 0;
+}
@@ -0,0 +1,73 @@
+#ifndef __CALLBACK_LIST_H__
+#define __CALLBACK_LIST_H__
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace robot
+{
+
+///////////////////////////////////////////////////////////
+//
+//                     callback list
+//
+///////////////////////////////////////////////////////////
+
+// connect copies the list and publishes it, call does not lock or
+// allocate; old lists live until destruction, so connects must be
+// bounded: configuration time, or once per parameter for runtime
+// subscribers (change_notifier::watch connects on first subscription
+// of a parameter only)
+
+class callback_list
+{
+public:
+    using f_t = std::function<void()>;
+private:
+    using list_t = std::vector<f_t>;
+
+    std::atomic<const list_t*> current;
+
+    std::mutex m; // connect
+    std::vector<std::unique_ptr<const list_t>> lists; // current and retired
+public:
+    callback_list(): current(nullptr) {}
+
+    callback_list(const callback_list&) = delete;
+    callback_list& operator=(const callback_list&) = delete;
+
+    void connect(const f_t& f)
+    {
+        std::lock_guard<std::mutex> lock(m);
+
+        const list_t* old = current.load(std::memory_order_relaxed);
+
+        std::unique_ptr<list_t> n(old ? new list_t(*old) : new list_t());
+        n->push_back(f);
+
+        current.store(n.get(), std::memory_order_release);
+        lists.push_back(std::move(n));
+    }
+
+    bool empty() const
+    {
+        return current.load(std::memory_order_acquire) == nullptr;
+    }
+
+    void operator()() const
+    {
+        const list_t* l = current.load(std::memory_order_acquire);
+        if(!l)
+            return;
+
+        for(auto& f : *l)
+            f();
+    }
+};
+
+}
+
+#endif // __CALLBACK_LIST_H__
@@ -8,10 +8,10 @@
 #include <mutex>
 #include <limits>
 
-#include <boost/signals2.hpp>
-
 #include "dimension.h"
 #include "connection.h"
+#include "callback_list.h"
+#include "metrics.h"
 
 namespace robot
 {
@@ -33,6 +33,18 @@ struct parameter_access_error: public std::logic_error
     {}
 };
 
+struct function_access_error: public std::logic_error
+{
+    uint16_t f_code;
+    uint16_t f_number;
+
+    function_access_error(uint16_t c, uint16_t n):
+        std::logic_error("error: unknown function"),
+        f_code(c),
+        f_number(n)
+    {}
+};
+
 ///////////////////////////////////////////////////////////
 //
 //                   Common protocol
@@ -71,6 +83,8 @@ using data_access_group_key = uint16_constant<0x2>;
 
 using protocol_version_key = uint16_constant<0x0>;
 using protocol_version = uint16_t;
+
+constexpr protocol_version PROTOCOL_VERSION = 0x0000; // the only one
 //
 using active_connections_request_key = uint16_constant<0x1>;
 using active_connections_request = std::tuple<>;
@@ -113,6 +127,14 @@ using disconnect_request = std::tuple<>;
 //
 using disconnect_code_key = uint16_constant<0x7>;
 using disconnect_code = uint16_t;
+
+constexpr uint16_t DISCONNECT_BY_REQUEST    = 0x0000;
+constexpr uint16_t DISCONNECT_LOW_PRIORITY  = 0x0100; // | min priority to get slot
+constexpr uint16_t DISCONNECT_NO_FREE_SLOTS = 0x0200; // | min priority to get slot
+constexpr uint16_t DISCONNECT_AUTONOMOUS    = 0x0300;
+constexpr uint16_t DISCONNECT_LOW_POWER     = 0xFF00;
+constexpr uint16_t DISCONNECT_SW_FAILURE    = 0xFF01;
+constexpr uint16_t DISCONNECT_HW_FAILURE    = 0xFF02;
 //
 using command_return_code_key = uint16_constant<0x8>;
 
@@ -126,6 +148,46 @@ std::tuple
     pair<return_code_key, uint16_t>
 >;
 
+// high bit is error flag (except CMD_POSTPONED)
+constexpr uint16_t CMD_IN_PROGRESS   = 0x0000;
+constexpr uint16_t CMD_DONE          = 0x0001;
+constexpr uint16_t CMD_POSTPONED     = 0x8000;
+constexpr uint16_t CMD_BAD_FORMAT    = 0xFFFE;
+constexpr uint16_t CMD_NOT_SUPPORTED = 0xFFFF;
+//
+using metrics_request_key = uint16_constant<0x9>;
+using metrics_request = std::tuple<>;
+//
+using metrics_info_key = uint16_constant<0xA>;
+
+struct bytes_in_key;
+struct bytes_out_key;
+struct message_counts_key;
+struct histograms_key;
+struct count_key;
+struct p50_key;
+struct p99_key;
+struct max_key;
+
+// decode, dispatch, encode, reg action (ns), SIP interval (us)
+using histogram_summary =
+std::tuple
+<
+    pair<count_key, uint64_t>,
+    pair<p50_key  , uint64_t>,
+    pair<p99_key  , uint64_t>,
+    pair<max_key  , uint64_t>
+>;
+
+using metrics_info =
+std::tuple
+<
+    pair<bytes_in_key      , uint64_t>,
+    pair<bytes_out_key     , uint64_t>,
+    pair<message_counts_key, repeat<uint16_t, std::tuple<uint16_t, uint16_t, uint64_t>>>,
+    pair<histograms_key    , repeat<uint8_t, histogram_summary>>
+>;
+
 ///////////////// config group ////////////////////////////
 
 // function map utils
@@ -275,7 +337,9 @@ std::tuple
     MSG_TYPE(control_level_deactivation_request),
     MSG_TYPE(disconnect_request),
     MSG_TYPE(disconnect_code),
-    MSG_TYPE(command_return_code)
+    MSG_TYPE(command_return_code),
+    MSG_TYPE(metrics_request),
+    MSG_TYPE(metrics_info)
 >;
 
 using config_group =
@@ -422,6 +486,59 @@ std::tuple
     pair<details::dimension_key          , repeat<uint8_t, uint8_t>>
 >;
 
+///////////////////////////////////////////////////////////
+//
+//                  Parameter value arena
+//
+///////////////////////////////////////////////////////////
+
+// values of parameters of one function in contiguous memory;
+// chunks are never moved, so value spans stay valid
+
+class value_arena
+{
+    enum { CHUNK_SIZE = 4096 };
+
+    std::vector<std::unique_ptr<char[]>> chunks;
+    size_t used;  // bytes of last chunk
+    size_t chunk; // size of last chunk
+public:
+    value_arena(): used(0), chunk(0) {}
+
+    value_arena(const value_arena&) = delete;
+    value_arena& operator=(const value_arena&) = delete;
+
+    void* allocate(size_t size, size_t align)
+    {
+        size_t offset = (used + align - 1) / align * align;
+
+        if(chunks.empty() || offset + size > chunk) {
+            chunk = std::max<size_t>(CHUNK_SIZE, size + align);
+            chunks.emplace_back(new char[chunk]);
+            offset = 0;
+        }
+
+        char* base = chunks.back().get();
+
+        // chunk start is aligned for fundamental types only
+        size_t mis = reinterpret_cast<uintptr_t>(base + offset) % align;
+        if(mis != 0)
+            offset += align - mis;
+
+        used = offset + size;
+        return base + offset;
+    }
+
+    // values are constructed in arena
+    template <typename V>
+    value_span<V> make_span(size_t count)
+    {
+        V* p = static_cast<V*>(allocate(count * sizeof(V), alignof(V)));
+        std::uninitialized_fill(p, p + count, V());
+        return value_span<V>(p, count);
+    }
+};
+
 ///////////////////////////////////////////////////////////
 //
 //                      Parameter
@@ -439,6 +556,10 @@ public:
     virtual any get_config() const { return invalid_ret(); }
     virtual any get_value_writer() { return invalid_ret(); }
 
+    // value is decoded into stage, applied after all values of message
+    virtual any get_stage_writer() { return invalid_ret(); }
+    virtual void apply_stage() { access_error(); }
+
     virtual std::tuple<any, uint8_t> get_value_reader()
     {
         return std::tuple<any, uint8_t>(invalid_ret(), 0);
@@ -447,25 +568,39 @@ public:
     virtual void on_read()  { access_error(); }
     virtual void on_write() { access_error(); }
 
-    virtual void add_read_action (const f_t&, size_t p = 0) { access_error(); }
-    virtual void add_write_action(const f_t&, size_t p = 0) { access_error(); }
+    virtual void add_read_action  (const f_t&, size_t p = 0) { access_error(); }
+    virtual void add_write_action (const f_t&, size_t p = 0) { access_error(); }
+    virtual void add_update_action(const f_t&) { access_error(); }
+
+    virtual void on_update() { access_error(); }
     
     virtual void set_read()  { access_error(); }    
     virtual void set_write() { access_error(); }
 
     virtual uint8_t get_p_code() const = 0; // HACK or not?
+
+    // parameter is placed into function: values move to its arena
+    virtual void place_values(value_arena&) {}
 };
 
 template <uint8_t PARAMETER_TYPE, typename V>
 class parameter: public parameter_base
 {
     parameter_config<V> config;
-    std::vector<V> value;
+
+    std::vector<V> own; // values before placement into function arena
+    value_span<V> value;
+
+    std::vector<V> stage_values; // decoded write, writable parameters only
+    value_span<V> stage;
+
+    // values are owned by device (see reg): copied to span by reader
+    std::function<void(const value_span<V>&)> source;
 
     class rw_action
     {
         bool ready = false;
-        boost::signals2::signal<void()> actions;
+        callback_list actions;
     public:
         void operator()()
         {
@@ -483,6 +618,8 @@ class parameter: public parameter_base
     rw_action read_actions; // actions after value read
     rw_action write_actions; // actions after value write
 
+    callback_list update_actions; // value changed by device
+
     // check access for read/write
     template <uint8_t FLAG>
     void check_flag() const
@@ -491,23 +628,30 @@ class parameter: public parameter_base
             access_error();
     }
 
-    void set_field_count()
+    size_t field_count() const
     {
         using namespace details;
-
-        size_t field_count =
-        get<field_count_key>(get<value_type_config_key>(config));
-
-        value.resize(field_count);
+        return get<field_count_key>(get<value_type_config_key>(config));
     }
 public:
     parameter(const parameter_config<V>& conf) :
-        config(conf)
+        config(conf),
+        own(field_count()),
+        value(own.data(), own.size()),
+        stage_values((PARAMETER_TYPE & WRITE_FLAG) ? field_count() : 0),
+        stage(stage_values.data(), stage_values.size())
+    {}
+
+    void place_values(value_arena& arena)
     {
-        set_field_count();
+        value_span<V> span = arena.make_span<V>(value.size());
+        std::copy(value.begin(), value.end(), span.begin());
+        value = span;
+
+        std::vector<V>().swap(own);
     }
 
-    std::vector<V>& val_ref() { return value; } // TODO ugly hack
+    value_span<V>& val_ref() { return value; } // TODO ugly hack
     uint8_t get_p_code() const
     {
         using namespace details;
@@ -516,10 +660,15 @@ public:
 
     any get_config() const {  return make_storage(config); }
 
+    // span is written by reading (protocol) thread only
+    void set_value_source(const std::function<void(const value_span<V>&)>& f) { source = f; }
+
     // rw interface
     std::tuple<any, uint8_t> get_value_reader()
     {
         check_flag<READ_FLAG>();
+        if(source)
+            source(value);
         return std::tuple<any, uint8_t>(make_storage_ref(value), 0);
     }
 
@@ -529,6 +678,18 @@ public:
         return make_storage_ref(value);
     }
 
+    any get_stage_writer()
+    {
+        check_flag<WRITE_FLAG>();
+        return make_storage_ref(stage);
+    }
+
+    void apply_stage()
+    {
+        check_flag<WRITE_FLAG>();
+        std::copy(stage.begin(), stage.end(), value.begin());
+    }
+
     // add actions
     void add_read_action(const parameter_base::f_t& f)
     {
@@ -542,9 +703,17 @@ public:
         write_actions.add(f);
     }
 
+    void add_update_action(const parameter_base::f_t& f)
+    {
+        check_flag<READ_FLAG>();
+        update_actions.connect(f);
+    }
+
     void on_read()  { check_flag<READ_FLAG >(); read_actions();  }
     void on_write() { check_flag<WRITE_FLAG>(); write_actions(); }
 
+    void on_update() { check_flag<READ_FLAG>(); update_actions(); }
+
     void set_read()  { check_flag<READ_FLAG >(); read_actions.set_ready();  }
     void set_write() { check_flag<WRITE_FLAG>(); write_actions.set_ready(); }
 };
@@ -690,7 +859,70 @@ enum class FunctionCodes : uint16_t
     SENSOR_1D = 2
 };
 
-using function_base = std::map<uint8_t, std::shared_ptr<parameter_base>>;
+// function's parameter: values are placed into function arena on assignment
+
+class parameter_slot
+{
+    std::shared_ptr<parameter_base> p;
+    value_arena* arena;
+public:
+    parameter_slot(): arena(0) {}
+
+    void set_arena(value_arena* a) { arena = a; }
+
+    parameter_slot& operator=(const std::shared_ptr<parameter_base>& n)
+    {
+        p = n;
+        if(p && arena)
+            p->place_values(*arena);
+        return *this;
+    }
+
+    parameter_base* get() const { return p.get(); }
+    parameter_base* operator->() const { return p.get(); }
+    explicit operator bool() const { return bool(p); }
+
+    const std::shared_ptr<parameter_base>& ptr() const { return p; }
+};
+
+// parameters by p_code: fixed slots, null - no parameter
+
+class function_base
+{
+public:
+    enum { SLOTS = 256 };
+private:
+    std::shared_ptr<value_arena> arena; // shared by copies of function
+    std::array<parameter_slot, SLOTS> params;
+public:
+    function_base(): arena(std::make_shared<value_arena>())
+    {
+        for(auto& p : params)
+            p.set_arena(arena.get());
+    }
+
+    // configuration
+    parameter_slot& operator[](uint8_t p_code) { return params[p_code]; }
+
+    parameter_base* find(uint8_t p_code) const { return params[p_code].get(); }
+
+    parameter_base& at(uint8_t p_code) const
+    {
+        parameter_base* p = find(p_code);
+        if(!p)
+            throw parameter_access_error(p_code);
+        return *p;
+    }
+
+    // existing parameters in p_code order
+    template <typename F>
+    void for_each(const F& f) const
+    {
+        for(auto& p : params)
+            if(p)
+                f(*p.get());
+    }
+};
 
 template <FunctionCodes F_CODE, uint8_t P_COUNT>
 class function : public function_base
@@ -698,10 +930,8 @@ class function : public function_base
 public:
     function()
     {
-        for(uint8_t i = 0; i < P_COUNT; i++) {
-            auto empty_p = std::make_shared<na_parameter>(na_parameter(i));
-            insert(std::make_pair(i, empty_p));
-        }
+        for(uint8_t i = 0; i < P_COUNT; i++)
+            (*this)[i] = std::make_shared<na_parameter>(na_parameter(i));
     }
 };
 
@@ -717,27 +947,79 @@ using sensor_1D_function    = function<FunctionCodes::SENSOR_1D     , 0x0B>;
 class robot_state
 {
 protected:
-    using same_type_function_group_t = std::map<uint16_t, function_base>;
-    using function_map_t = std::map<uint16_t, same_type_function_group_t>;
+    using function_ptr = std::unique_ptr<function_base>;
+
+    // dense tables by f_code, f_number: stable function addresses
+    std::vector<std::vector<function_ptr>> functions;
+
+    bool frozen; // no new functions after configuration
+
+    function_base* find_function(uint16_t f_code, uint16_t f_number) const
+    {
+        if(f_code >= functions.size() || f_number >= functions[f_code].size())
+            return 0;
+        return functions[f_code][f_number].get();
+    }
 
-    function_map_t function_map;
+    // hot path: unknown function is rejected, not created
+    function_base& function_at(uint16_t f_code, uint16_t f_number) const
+    {
+        function_base* f = find_function(f_code, f_number);
+        if(!f)
+            throw function_access_error(f_code, f_number);
+        return *f;
+    }
+
+    parameter_base& parameter_at
+    (
+        uint16_t f_code,
+        uint16_t f_number,
+        uint8_t p_code
+    ) const
+    {
+        return function_at(f_code, f_number).at(p_code);
+    }
 public:
+    robot_state(): frozen(false) {}
+
+    robot_state(const robot_state&) = delete;
+    robot_state& operator=(const robot_state&) = delete;
+
+    // configuration: function is created if not frozen
     function_base& get_function_ref(uint16_t f_code, uint16_t f_number)
     {
-        // TODO check index
-        return function_map[f_code][f_number];
+        function_base* f = find_function(f_code, f_number);
+        if(f)
+            return *f;
+
+        if(frozen)
+            throw function_access_error(f_code, f_number);
+
+        if(f_code >= functions.size())
+            functions.resize(f_code + 1);
+
+        auto& group = functions[f_code];
+        if(f_number >= group.size())
+            group.resize(f_number + 1);
+
+        group[f_number].reset(new function_base());
+        return *group[f_number];
     }
 
-    std::shared_ptr<parameter_base>& parameter_ref
+    parameter_slot& parameter_ref
     (
         uint16_t f_code,
         uint16_t f_number,
         uint8_t p_code
     )
     {
-        // TODO check index
-        return function_map[f_code][f_number][p_code];
+        return get_function_ref(f_code, f_number)[p_code];
     }
+
+    // function table is complete
+    void freeze() { frozen = true; }
+    bool is_frozen() const { return frozen; }
+
     // service information
     
     // function list
@@ -746,41 +1028,37 @@ public:
         using namespace common_protocol;
         function_list res;
 
-        for(auto& p : function_map)
-            for(auto& f: p.second)
-                res.push_back(function_id_t(p.first, f.first));
+        for(size_t c = 0; c < functions.size(); c++)
+            for(size_t n = 0; n < functions[c].size(); n++)
+                if(functions[c][n])
+                    res.push_back(function_id_t(c, n));
 
         return res;
     }
 
-    template <typename IStream>
-    void update_function_list(IStream& is)
+    void update_function_list(const common_protocol::function_list& l)
     {
-        uint32_t num_of_functions;
-        is >> num_of_functions;
-
-        for(size_t i = 0; i < num_of_functions; i++) {
-            uint16_t f_code, f_num;
-            is >> f_code >> f_num;
-            function_map[f_code][f_num];
-        }
+        for(auto& f : l)
+            get_function_ref(std::get<0>(f), std::get<1>(f));
     }
 
     // config
-    template <typename IStream>
-    common_protocol::function_config get_function_config(IStream& is)
+    common_protocol::function_config
+    get_function_config(uint16_t f_code, uint16_t f_number)
     {
         using namespace common_protocol;
 
-        uint16_t f_code, f_number;
-        is >> f_code >> f_number;
-
         common_protocol::function_config res;
 
         get<0>(res) = function_id_t(f_code, f_number);
 
-        for(auto& p : function_map[f_code][f_number])
-            get<1>(res).push_back(p.second->get_config());
+        function_at(f_code, f_number).for_each
+        (
+            [&res](const parameter_base& p)
+            {
+                get<1>(res).push_back(p.get_config());
+            }
+        );
 
         return res;
     }
@@ -797,34 +1075,83 @@ public:
         for(size_t i = 0; i < num_of_params; i++) {
             auto new_param = make_parameter_from_config(is);
             uint8_t p_code = new_param->get_p_code();
-            function_map[f_code][f_number][p_code] = new_param;
+            parameter_ref(f_code, f_number, p_code) = new_param;
         }
     }
 
-    // value read
-    template <typename IStream>
-    common_protocol::function_value_read get_read_values(IStream& is)
+    // value read, reply storage is reused
+    void get_read_values
+    (
+        const common_protocol::function_value_read_request& req,
+        common_protocol::function_value_read& res
+    )
     {
         using namespace common_protocol;
 
-        uint16_t f_code, f_number;
-        is >> f_code >> f_number;
+        uint16_t f_code = std::get<0>(std::get<0>(req));
+        uint16_t f_number = std::get<1>(std::get<0>(req));
 
-        uint8_t num_of_params;
-        is >> num_of_params;
+        get<0>(res) = function_id_t(f_code, f_number);
+        get<1>(res).clear();
+
+        const function_base& f = function_at(f_code, f_number);
+
+        for(auto& p : std::get<1>(req)) {
+            uint8_t p_code = std::get<0>(p); // TODO flags
+            get<1>(res).emplace_back(p_code, f.at(p_code).get_value_reader());
+        }
+    }
+
+    common_protocol::function_value_read
+    get_read_values(const common_protocol::function_value_read_request& req)
+    {
+        common_protocol::function_value_read res;
+        get_read_values(req, res);
+        return res;
+    }
+
+    // parameter exists and has read access
+    bool is_readable(uint16_t f_code, uint16_t f_number, uint8_t p_code) const
+    {
+        function_base* f = find_function(f_code, f_number);
+        if(!f)
+            return false;
+
+        parameter_base* p = f->find(p_code);
+        if(!p)
+            return false;
+
+        try {
+            p->get_value_reader();
+        }
+        catch(const parameter_access_error&) {
+            return false;
+        }
+
+        return true;
+    }
+
+    // values of listed parameters (subscriptions)
+    common_protocol::function_value_read get_read_values
+    (
+        uint16_t f_code,
+        uint16_t f_number,
+        const std::vector<uint8_t>& p_codes
+    )
+    {
+        using namespace common_protocol;
 
         function_value_read res;
 
         get<0>(res) = function_id_t(f_code, f_number);
 
-        for(size_t i = 0; i < num_of_params; i++) {
-            // TODO check_index, exc
-            uint8_t p_code, p_flags;
-            is >> p_code >> p_flags; // TODO flags
+        const function_base& f = function_at(f_code, f_number);
+
+        for(uint8_t p_code : p_codes) {
             std::tuple<uint8_t, std::tuple<any, uint8_t>> v
             (
                 p_code,
-                function_map[f_code][f_number][p_code]->get_value_reader()
+                f.at(p_code).get_value_reader()
             );
             get<1>(res).push_back(v);
         }
@@ -841,12 +1168,13 @@ public:
         uint8_t num_of_params;
         is >> num_of_params;
 
+        const function_base& f = function_at(f_code, f_number);
+
         for(size_t i = 0; i < num_of_params; i++) {
             uint8_t p_code;
             is >> p_code;
 
-            auto reader =
-            function_map[f_code][f_number][p_code]->get_value_reader();
+            auto reader = f.at(p_code).get_value_reader();
             is >> reader;
         }
     }
@@ -868,12 +1196,13 @@ public:
 
         get<0>(res) = function_id_t(f_code, f_number);
 
+        const function_base& f = function_at(f_code, f_number);
+
         for(size_t i = 0; i < num_of_params; i++) {
-            // TODO check_index, exc
             uint8_t p_code;
             is >> p_code;
 
-            any v = function_map[f_code][f_number][p_code]->get_value_writer();
+            any v = f.at(p_code).get_value_writer();
             get<1>(res).push_back(p_wr_t(p_code, v));
         }
 
@@ -889,52 +1218,362 @@ public:
         uint8_t num_of_params;
         is >> num_of_params;
 
+        const function_base& f = function_at(f_code, f_number);
+
+        // all values are decoded and checked first:
+        // no value is changed if one can not be written
+        parameter_base* staged[UINT8_MAX];
+
         for(size_t i = 0; i < num_of_params; i++) {
             uint8_t p_code;
             is >> p_code;
 
-            auto& p = function_map[f_code][f_number][p_code];
-            auto writer = p->get_value_writer();
+            staged[i] = &f.at(p_code);
+            auto writer = staged[i]->get_stage_writer();
             is >> writer;
-            p->set_write();
-            p->on_write();
         }
 
+        for(size_t i = 0; i < num_of_params; i++) {
+            staged[i]->apply_stage();
+            staged[i]->set_write();
+        }
+
+        for(size_t i = 0; i < num_of_params; i++)
+            staged[i]->on_write();
     }
     // labels
 };
 
-class client_server_base
+namespace common_protocol
 {
-protected:
-    template <typename Group, typename Type>
-    common_protocol::message<Group, Type>
-    make_message
+
+template <typename Group, typename Type>
+inline message_header
+make_header(const message_body<Group, Type>& m, uint32_t msg_num = 0)
+{
+    message_header header;
+
+    get<group_key      >(header) = Group::value;
+    get<type_key       >(header) = Type::value;
+    get<message_num_key>(header) = msg_num;
+    get<data_size_key  >(header) = calc_size(m);
+
+    return header;
+}
+
+// single pass: header, body, then data size is patched in header
+template <typename Group, typename Type>
+inline void write_message
+(
+    binary_ostream& os,
+    const message_body<Group, Type>& m,
+    uint32_t msg_num = 0
+)
+{
+    message_header header;
+
+    get<group_key      >(header) = Group::value;
+    get<type_key       >(header) = Type::value;
+    get<message_num_key>(header) = msg_num;
+    get<data_size_key  >(header) = 0;
+
+    size_t start = os.pos();
+
+    os << header << m;
+
+    constexpr size_t header_size = static_size<message_header>::value;
+    constexpr size_t size_offset = static_offset<data_size_key, message_header>::value;
+
+    os.patch(start + size_offset, uint32_t(os.pos() - start - header_size));
+}
+
+template <typename Group, typename Type>
+inline message<Group, Type>
+make_message(const message_body<Group, Type>& m, uint32_t msg_num = 0)
+{
+    message<Group, Type> ret;
+
+    get<header_key>(ret) = make_header<Group, Type>(m, msg_num);
+    get<body_key  >(ret) = m;
+
+    return ret;
+}
+
+///////////////////////////////////////////////////////////
+//
+//                  message dispatch
+//
+///////////////////////////////////////////////////////////
+
+// handler binds a message type by overload:
+//   void on_message(message_tag<Group, Type>, const message_header&, const Body&)
+// or, for bodies holding parameter values (any), which need robot state
+// to be decoded:
+//   void on_message(message_tag<Group, Type>, const message_header&, binary_istream&)
+// unbound types go to
+//   void not_supported(const message_header&)
+
+template <typename Group, typename Type>
+struct message_tag
+{
+    using group = Group;
+    using type = Type;
+    using body = message_body<Group, Type>;
+};
+
+namespace details
+{
+
+// body can be decoded without robot state
+template <typename T>
+struct is_decodable : std::true_type {};
+
+template <>
+struct is_decodable<any> : std::false_type {};
+
+template <typename Key, typename Val>
+struct is_decodable<pair<Key, Val>> : is_decodable<Val> {};
+
+template <typename SizeType, typename T>
+struct is_decodable<repeat<SizeType, T>> : is_decodable<T> {};
+
+template <>
+struct is_decodable<std::tuple<>> : std::true_type {};
+
+template <typename Head, typename ...Tail>
+struct is_decodable<std::tuple<Head, Tail...>> :
+std::integral_constant
+<
+    bool,
+    is_decodable<Head>::value && is_decodable<std::tuple<Tail...>>::value
+>
+{};
+
+// type keys of group are table indices
+template <size_t I>
+constexpr bool dense_keys() { return true; }
+
+template <size_t I, typename Head, typename ...Tail>
+constexpr bool dense_keys()
+{
+    return Head::value == I && dense_keys<I + 1, Tail...>();
+}
+
+template <typename Dispatcher, typename Group, typename Types>
+struct dispatch_row;
+
+template <typename Dispatcher, typename Group, typename ...Key, typename ...Body>
+struct dispatch_row<Dispatcher, Group, std::tuple<pair<Key, Body>...>>
+{
+    using entry_t = typename Dispatcher::entry_t;
+
+    static_assert(dense_keys<0, Key...>(), "message types are not dense");
+
+    static constexpr size_t size = sizeof...(Key);
+    static constexpr entry_t entries[sizeof...(Key)] =
+    {
+        &Dispatcher::template invoke<message_tag<Group, Key>>...
+    };
+};
+
+template <typename Dispatcher, typename Group, typename ...Key, typename ...Body>
+constexpr typename Dispatcher::entry_t
+dispatch_row<Dispatcher, Group, std::tuple<pair<Key, Body>...>>::entries[];
+
+template <typename Dispatcher, typename Table>
+struct dispatch_table;
+
+template <typename Dispatcher, typename ...Group, typename ...Types>
+struct dispatch_table<Dispatcher, std::tuple<pair<Group, Types>...>>
+{
+    using entry_t = typename Dispatcher::entry_t;
+
+    static_assert(dense_keys<0, Group...>(), "message groups are not dense");
+
+    struct row
+    {
+        const entry_t* entries;
+        size_t size;
+    };
+
+    static constexpr size_t size = sizeof...(Group);
+    static constexpr row rows[sizeof...(Group)] =
+    {
+        {
+            dispatch_row<Dispatcher, Group, Types>::entries,
+            dispatch_row<Dispatcher, Group, Types>::size
+        }...
+    };
+};
+
+template <typename Dispatcher, typename ...Group, typename ...Types>
+constexpr typename dispatch_table<Dispatcher, std::tuple<pair<Group, Types>...>>::row
+dispatch_table<Dispatcher, std::tuple<pair<Group, Types>...>>::rows[];
+
+}
+
+// jump table generated from common_protocol_table, (group, type) -> handler,
+// handler class declares dispatcher as friend
+template <typename Handler>
+class message_dispatcher
+{
+public:
+    using entry_t = void(*)(Handler&, const message_header&, binary_istream&);
+private:
+    template <typename Tag>
+    using arg_t =
+    typename std::conditional
+    <
+        details::is_decodable<typename Tag::body>::value,
+        const typename Tag::body,
+        binary_istream
+    >::type;
+
+    template <typename Tag>
+    struct is_bound
+    {
+        template <typename H>
+        static auto test(int) ->
+        decltype
+        (
+            std::declval<H&>().on_message
+            (
+                Tag(),
+                std::declval<const message_header&>(),
+                std::declval<arg_t<Tag>&>()
+            ),
+            std::true_type()
+        );
+
+        template <typename H>
+        static std::false_type test(...);
+
+        static constexpr bool value = decltype(test<Handler>(0))::value;
+    };
+
+    enum { NOT_BOUND, STREAM, BODY };
+
+    template <typename Tag>
+    using kind =
+    std::integral_constant
+    <
+        int,
+        !is_bound<Tag>::value ? NOT_BOUND :
+        details::is_decodable<typename Tag::body>::value ? BODY : STREAM
+    >;
+
+    template <typename Tag>
+    static void call
     (
-        const common_protocol::message_body<Group, Type>& m,
-        uint32_t msg_num = 0
+        Handler& h,
+        const message_header& header,
+        binary_istream&,
+        std::integral_constant<int, NOT_BOUND>
     )
     {
-        using namespace common_protocol;
+        h.not_supported(header);
+    }
 
-        message<Group, Type> ret;
+    template <typename Tag>
+    static void call
+    (
+        Handler& h,
+        const message_header& header,
+        binary_istream& is,
+        std::integral_constant<int, STREAM>
+    )
+    {
+        h.on_message(Tag(), header, is);
+    }
 
-        auto& header = get<header_key>(ret);
-        
-        get<group_key      >(header) = Group::value;
-        get<type_key       >(header) = Type::value;
-        get<message_num_key>(header) = msg_num;
-        get<data_size_key  >(header) = calc_size(m);
+    template <typename Tag>
+    static void call
+    (
+        Handler& h,
+        const message_header& header,
+        binary_istream& is,
+        std::integral_constant<int, BODY>
+    )
+    {
+        // decoded bodies keep capacity between messages
+        static thread_local typename Tag::body body;
+        {
+            metrics::scope_timer t(metrics::DECODE);
+            is >> body;
+        }
 
-        auto& body = get<body_key>(ret);
+        const typename Tag::body& b = body;
+        h.on_message(Tag(), header, b);
+    }
 
-        body = m;
+    using table = details::dispatch_table<message_dispatcher, common_protocol_table>;
+public:
+    template <typename Tag>
+    static void invoke(Handler& h, const message_header& header, binary_istream& is)
+    {
+        call<Tag>(h, header, is, kind<Tag>());
+    }
 
-        return ret;
-    };
+    static void dispatch(Handler& h, const message_header& header, binary_istream& is)
+    {
+        uint16_t group = get<group_key>(header);
+        uint16_t type = get<type_key>(header);
+
+        if(group >= table::size || type >= table::rows[group].size) {
+            h.not_supported(header);
+            return;
+        }
+
+        table::rows[group].entries[type](h, header, is);
+    }
+};
+
+// reply to command message
+inline command_return_code return_code(const message_header& header, uint16_t code)
+{
+    command_return_code res;
+    get<command_num_key>(res) = get<message_num_key>(header);
+    get<return_code_key>(res) = code;
+    return res;
+}
+
+// reply to unbound message
+inline command_return_code not_supported_code(const message_header& header)
+{
+    return return_code(header, CMD_NOT_SUPPORTED);
+}
+
+inline metrics_info make_metrics_info(const metrics::snapshot& s)
+{
+    metrics_info info;
+    get<bytes_in_key>(info) = s.bytes_in;
+    get<bytes_out_key>(info) = s.bytes_out;
+
+    auto& counts = get<message_counts_key>(info);
+    counts.assign(s.messages.begin(), s.messages.end());
+
+    auto& hist = get<histograms_key>(info);
+    for(auto& v : s.hist) {
+        histogram_summary h;
+        get<count_key>(h) = v.count;
+        get<p50_key>(h) = v.p50;
+        get<p99_key>(h) = v.p99;
+        get<max_key>(h) = v.max;
+        hist.push_back(h);
+    }
+
+    return info;
+}
+
+}
 
+class client_server_base
+{
+protected:
     connection io;
-    robot_state r;
+
+    std::shared_ptr<robot_state> state; // may be shared between sessions
+    robot_state& r;
 
     template <typename Group, typename Type>
     void send_message
@@ -943,14 +1582,32 @@ protected:
         uint32_t msg_num = 0
     )
     {
-        io.write(make_message<Group, Type>(m, msg_num));
+        io.write_stream
+        (
+            [&m, msg_num](binary_ostream& os)
+            {
+                metrics::scope_timer t(metrics::ENCODE);
+                common_protocol::write_message<Group, Type>(os, m, msg_num);
+            }
+        );
     }
 
     template <typename T>
-    client_server_base(const T& t): io(t) {}
+    client_server_base(const T& t):
+        io(t),
+        state(std::make_shared<robot_state>()),
+        r(*state)
+    {}
+
+    template <typename T>
+    client_server_base(const T& t, const std::shared_ptr<robot_state>& s):
+        io(t),
+        state(s),
+        r(*state)
+    {}
 public:
 
-    std::shared_ptr<parameter_base>& parameter_ref
+    parameter_slot& parameter_ref
     (
         uint16_t f_code,
         uint16_t f_number,
@@ -968,10 +1625,239 @@ public:
 
 class server : public client_server_base
 {
+    friend class common_protocol::message_dispatcher<server>;
+
+    common_protocol::function_value_read read_reply; // keeps capacity
+
+    // unknown ids in request are answered, connection is kept
+    void bad_format(const common_protocol::message_header& header)
+    {
+        using namespace common_protocol;
+        send_message
+        <
+            service_group_key,
+            command_return_code_key
+        >(return_code(header, CMD_BAD_FORMAT), get<message_num_key>(header));
+    }
+
+    // read request with unknown or not readable parameters:
+    // they are denied, others are read
+    void read_filtered
+    (
+        const common_protocol::message_header& header,
+        const common_protocol::function_value_read_request& req
+    )
+    {
+        using namespace common_protocol;
+
+        uint16_t f_code = std::get<0>(std::get<0>(req));
+        uint16_t f_number = std::get<1>(std::get<0>(req));
+
+        function_value_read_request readable;
+        function_value_read_denied denied;
+
+        std::get<0>(readable) = std::get<0>(req);
+
+        for(auto& p : std::get<1>(req))
+            if(r.is_readable(f_code, f_number, std::get<0>(p)))
+                std::get<1>(readable).push_back(p);
+            else
+                denied.push_back(std::tuple<uint8_t, uint8_t>(std::get<0>(p), 0));
+
+        send_message
+        <
+            data_access_group_key,
+            function_value_read_denied_key
+        >(denied, get<message_num_key>(header));
+
+        if(std::get<1>(readable).empty())
+            return;
+
+        r.get_read_values(readable, read_reply);
+
+        send_message
+        <
+            data_access_group_key,
+            function_value_read_key
+        >(read_reply);
+    }
+protected:
+    // message handlers: derived handler binds more types by overload,
+    // with using server::on_message and its own dispatcher
+
+    // config group
+
+    void on_message
+    (
+        common_protocol::message_tag
+        <
+            common_protocol::config_group_key,
+            common_protocol::function_list_request_key
+        >,
+        const common_protocol::message_header&,
+        const common_protocol::function_list_request&
+    )
+    {
+        using namespace common_protocol;
+        send_message<config_group_key, function_list_key>(r.get_f_list());
+    }
+
+    void on_message
+    (
+        common_protocol::message_tag
+        <
+            common_protocol::config_group_key,
+            common_protocol::function_config_request_key
+        >,
+        const common_protocol::message_header& header,
+        const common_protocol::function_config_request& req
+    )
+    {
+        using namespace common_protocol;
+
+        function_config config;
+        try {
+            config = r.get_function_config(std::get<0>(req), std::get<1>(req));
+        }
+        catch(const function_access_error&) {
+            bad_format(header);
+            return;
+        }
+
+        send_message<config_group_key, function_config_key>(config);
+    }
+
+    // data access group
+
+    void on_message
+    (
+        common_protocol::message_tag
+        <
+            common_protocol::data_access_group_key,
+            common_protocol::function_value_read_request_key
+        >,
+        const common_protocol::message_header& header,
+        const common_protocol::function_value_read_request& req
+    )
+    {
+        using namespace common_protocol;
+
+        try {
+            r.get_read_values(req, read_reply);
+        }
+        catch(const function_access_error&) {
+            read_filtered(header, req);
+            return;
+        }
+        catch(const parameter_access_error&) {
+            read_filtered(header, req);
+            return;
+        }
+
+        send_message
+        <
+            data_access_group_key,
+            function_value_read_key
+        >(read_reply);
+    }
+
+    void on_message
+    (
+        common_protocol::message_tag
+        <
+            common_protocol::data_access_group_key,
+            common_protocol::function_value_write_key
+        >,
+        const common_protocol::message_header& header,
+        binary_istream& is
+    )
+    {
+        // nothing is written if one value is bad
+        try {
+            r.write_function_values(is);
+        }
+        catch(const function_access_error&) {
+            bad_format(header);
+        }
+        catch(const parameter_access_error&) {
+            bad_format(header);
+        }
+    }
+
+    // service group
+
+    // only version 0x0000 is supported: it is proposed whatever peer asks
+    void on_message
+    (
+        common_protocol::message_tag
+        <
+            common_protocol::service_group_key,
+            common_protocol::protocol_version_key
+        >,
+        const common_protocol::message_header& header,
+        const common_protocol::protocol_version&
+    )
+    {
+        using namespace common_protocol;
+        send_message
+        <
+            service_group_key,
+            protocol_version_key
+        >(PROTOCOL_VERSION, get<message_num_key>(header));
+    }
+
+    // replies of peer are not answered
+    void on_message
+    (
+        common_protocol::message_tag
+        <
+            common_protocol::service_group_key,
+            common_protocol::command_return_code_key
+        >,
+        const common_protocol::message_header&,
+        const common_protocol::command_return_code&
+    )
+    {}
+
+    // totals of all threads of process
+    void on_message
+    (
+        common_protocol::message_tag
+        <
+            common_protocol::service_group_key,
+            common_protocol::metrics_request_key
+        >,
+        const common_protocol::message_header& header,
+        const common_protocol::metrics_request&
+    )
+    {
+        using namespace common_protocol;
+        send_message
+        <
+            service_group_key,
+            metrics_info_key
+        >(make_metrics_info(metrics::collect()), get<message_num_key>(header));
+    }
+
+    void not_supported(const common_protocol::message_header& header)
+    {
+        using namespace common_protocol;
+        send_message
+        <
+            service_group_key,
+            command_return_code_key
+        >(not_supported_code(header), get<message_num_key>(header));
+    }
 public:
     template <typename T>
     server(const T& t): client_server_base(t) {}
 
+    template <typename T>
+    server(const T& t, const std::shared_ptr<robot_state>& s):
+        client_server_base(t, s)
+    {}
+
+    // blocking read of one message from io
     void server_package_parse()
     {
         using namespace common_protocol;
@@ -979,115 +1865,170 @@ public:
         message_header header;
         io.read(header);
 
-        uint16_t msg_group, msg_type;
-        uint32_t msg_size;
-
-        msg_group = get<group_key>(header);
-        msg_type = get<type_key>(header);
-        msg_size = get<data_size_key>(header);
-
-        binary_buffer tmp_buf = io.read_buffer(msg_size);
-        binary_istream is(tmp_buf);
-
-        switch(msg_group) {
-            case service_group_key::value:
-                switch(msg_type) {
-                case protocol_version_key::value:
-                    break;
-                case active_connections_request_key::value:
-                    break;
-                case active_connections_info_key::value:
-                    break;
-                case control_level_up_request_key::value:
-                    break;
-                case control_level_activation_request_key::value:
-                    break;
-                case control_level_deactivation_request_key::value:
-                    break;
-                case disconnect_request_key::value:
-                    break;
-                case disconnect_code_key::value:
-                    break;
-                case command_return_code_key::value:
-                    break;
-                default: break;// TODO send error msg
-                }
-                break;
-            case config_group_key::value:
-                switch(msg_type) {
-                case config_version_request_key::value:
-                    break;
-                case config_version_key::value:
-                    break;
-                case function_list_request_key::value:
-                    send_message
-                    <
-                        config_group_key,
-                        function_list_key
-                    >(r.get_f_list());
-                    break;
-                case diff_function_list_request_key::value:
-                    break;
-                case function_list_key::value:
-                    break;
-                case function_config_request_key::value:
-                    send_message
-                    <
-                        config_group_key,
-                        function_config_key
-                    >(r.get_function_config(is));
-                    break;
-                case function_diff_config_request_key::value:
-                    break;
-                case function_config_key::value:
-                    break;
-                default: break;// TODO send error msg
-                }
-                    break;
-            case data_access_group_key::value:
-                switch(msg_type) {
-                case function_value_read_request_key::value:
-                    send_message
-                    <
-                        data_access_group_key,
-                        function_value_read_key
-                    >(r.get_read_values(is));
-                    break;
-                case function_value_read_on_update_1_time_request_key::value:
-                    break;
-                case function_value_read_on_update_request_key::value:
-                    break;
-                case function_value_read_periodical_request_key::value:
-                    break;
-                case function_value_update_cancel_key::value:
-                    break;
-                case function_value_periodical_update_cancel_key::value:
-                    break;
-                case function_value_read_key::value:
-                    break;
-                case function_value_read_denied_key::value:
-                    break;
-                case function_value_write_key::value:
-                    r.write_function_values(is);
-                    break;
-                case labels_format_request_key::value:
-                    break;
-                case labels_format_key::value:
-                    break;
-                default: break;// TODO send error msg
-                }
-                    break;
-            default:; // TODO send error msg
-                    break;
-        }
+        binary_istream is = io.read_stream(get<data_size_key>(header));
+
+        metrics::message(get<group_key>(header), get<type_key>(header));
+        metrics::scope_timer t(metrics::DISPATCH);
+        message_parse(header, is);
+    }
+
+    // process message already received by caller (see multi_server)
+    void message_parse
+    (
+        const common_protocol::message_header& header,
+        binary_istream& is
+    )
+    {
+        common_protocol::message_dispatcher<server>::dispatch(*this, header, is);
     }
 };
 
 class client : public client_server_base
 {
+    friend class common_protocol::message_dispatcher<client>;
+
+    common_protocol::metrics_info last_metrics; // reply to metrics_request
+
+    // last notifications of server
+    common_protocol::protocol_version peer_version;
+    common_protocol::disconnect_code last_disconnect;
+    common_protocol::active_connections_info last_connections;
+
+    void on_message
+    (
+        common_protocol::message_tag
+        <
+            common_protocol::config_group_key,
+            common_protocol::function_list_key
+        >,
+        const common_protocol::message_header&,
+        const common_protocol::function_list& l
+    )
+    {
+        r.update_function_list(l);
+    }
+
+    void on_message
+    (
+        common_protocol::message_tag
+        <
+            common_protocol::config_group_key,
+            common_protocol::function_config_key
+        >,
+        const common_protocol::message_header&,
+        binary_istream& is
+    )
+    {
+        r.update_function_config(is);
+    }
+
+    void on_message
+    (
+        common_protocol::message_tag
+        <
+            common_protocol::data_access_group_key,
+            common_protocol::function_value_read_key
+        >,
+        const common_protocol::message_header&,
+        binary_istream& is
+    )
+    {
+        r.update_function_read_values(is);
+    }
+
+    void on_message
+    (
+        common_protocol::message_tag
+        <
+            common_protocol::data_access_group_key,
+            common_protocol::function_value_write_key
+        >,
+        const common_protocol::message_header&,
+        binary_istream& is
+    )
+    {
+        r.write_function_values(is);
+    }
+
+    // replies of peer are not answered
+    void on_message
+    (
+        common_protocol::message_tag
+        <
+            common_protocol::service_group_key,
+            common_protocol::command_return_code_key
+        >,
+        const common_protocol::message_header&,
+        const common_protocol::command_return_code&
+    )
+    {}
+
+    void on_message
+    (
+        common_protocol::message_tag
+        <
+            common_protocol::service_group_key,
+            common_protocol::metrics_info_key
+        >,
+        const common_protocol::message_header&,
+        const common_protocol::metrics_info& m
+    )
+    {
+        last_metrics = m;
+    }
+
+    void on_message
+    (
+        common_protocol::message_tag
+        <
+            common_protocol::service_group_key,
+            common_protocol::protocol_version_key
+        >,
+        const common_protocol::message_header&,
+        const common_protocol::protocol_version& v
+    )
+    {
+        peer_version = v;
+    }
+
+    void on_message
+    (
+        common_protocol::message_tag
+        <
+            common_protocol::service_group_key,
+            common_protocol::disconnect_code_key
+        >,
+        const common_protocol::message_header&,
+        const common_protocol::disconnect_code& c
+    )
+    {
+        last_disconnect = c;
+    }
+
+    void on_message
+    (
+        common_protocol::message_tag
+        <
+            common_protocol::service_group_key,
+            common_protocol::active_connections_info_key
+        >,
+        const common_protocol::message_header&,
+        const common_protocol::active_connections_info& info
+    )
+    {
+        last_connections = info;
+    }
+
+    // other messages of server (read denied, labels...) are notifications:
+    // device does not send requests, nothing is answered
+    void not_supported(const common_protocol::message_header&) {}
 public:
     template <typename T>
-    client(const T& t): client_server_base(t) {}
+    client(const T& t):
+        client_server_base(t),
+        peer_version(0),
+        last_disconnect(0)
+    {}
 
     void update_config()
     {
@@ -1135,6 +2076,24 @@ public:
         >(req);
     }
 
+    // reply is read by client_package_parse, see get_metrics
+    void request_metrics()
+    {
+        using namespace common_protocol;
+        send_message<service_group_key, metrics_request_key>(std::tuple<>());
+    }
+
+    const common_protocol::metrics_info& get_metrics() const { return last_metrics; }
+
+    common_protocol::protocol_version get_peer_version() const { return peer_version; }
+
+    common_protocol::disconnect_code get_disconnect_code() const { return last_disconnect; }
+
+    const common_protocol::active_connections_info& get_connections_info() const
+    {
+        return last_connections;
+    }
+
     void client_package_parse()
     {
         using namespace common_protocol;
@@ -1142,97 +2101,11 @@ public:
         message_header header;
         io.read(header);
 
-        uint16_t msg_group, msg_type;
-        uint32_t msg_size;
-
-        msg_group = get<group_key>(header);
-        msg_type = get<type_key>(header);
-        msg_size = get<data_size_key>(header);
-
-        binary_buffer tmp_buf = io.read_buffer(msg_size);
-        binary_istream is(tmp_buf);
-
-        switch(msg_group) {
-            case service_group_key::value:
-                switch(msg_type) {
-                case protocol_version_key::value:
-                    break;
-                case active_connections_request_key::value:
-                    break;
-                case active_connections_info_key::value:
-                    break;
-                case control_level_up_request_key::value:
-                    break;
-                case control_level_activation_request_key::value:
-                    break;
-                case control_level_deactivation_request_key::value:
-                    break;
-                case disconnect_request_key::value:
-                    break;
-                case disconnect_code_key::value:
-                    break;
-                case command_return_code_key::value:
-                    break;
-                default: break;// TODO send error msg
-                }
-                break;
-            case config_group_key::value:
-                switch(msg_type) {
-                case config_version_request_key::value:
-                    break;
-                case config_version_key::value:
-                    break;
-                case function_list_request_key::value:
-                    break;
-                case diff_function_list_request_key::value:
-                    break;
-                case function_list_key::value:
-                    r.update_function_list(is);
-                    break;
-                case function_config_request_key::value:
-                    break;
-                case function_diff_config_request_key::value:
-                    break;
-                case function_config_key::value:
-                    r.update_function_config(is);
-                    break;
-                default: break;// TODO send error msg
-                }
-                break;
-            case data_access_group_key::value:
-                switch(msg_type) {
-                case function_value_read_request_key::value:
-                    break;
-                case function_value_read_on_update_1_time_request_key::value:
-                    break;
-                case function_value_read_on_update_request_key::value:
-                    break;
-                case function_value_read_periodical_request_key::value:
-                    break;
-                case function_value_update_cancel_key::value:
-                    break;
-                case function_value_periodical_update_cancel_key::value:
-                    break;
-                case function_value_read_key::value:
-                    r.update_function_read_values(is);
-                    break;
-                case function_value_read_denied_key::value:
-                    break;
-                case function_value_write_key::value:
-                    r.write_function_values(is);
-                    // TODO make & send write package
-                    break;
-                case labels_format_request_key::value:
-                    break;
-                case labels_format_key::value:
-                    break;
-                default:
-                    break;// TODO send error msg
-                }
-                break;
-            default:; // TODO send error msg
-                break;
-        }
+        binary_istream is = io.read_stream(get<data_size_key>(header));
+
+        metrics::message(get<group_key>(header), get<type_key>(header));
+        metrics::scope_timer t(metrics::DISPATCH);
+        message_dispatcher<client>::dispatch(*this, header, is);
     }
 };
 }
@@ -1,7 +1,10 @@
 #ifndef __CONNECTION_H__
 #define __CONNECTION_H__
 
+#include <mutex>
+#include <stdexcept>
 #include "dimension.h"
+#include "metrics.h"
 
 namespace robot
 {
@@ -13,8 +16,38 @@ class socket_wrapper_base
 public:
     virtual int read (      char* data, int size) = 0;
     virtual int write(const char* data, int size) = 0;
+
+    // socket's own output queue (0 if not supported): data is appended
+    // to it and sent by commit
+    virtual std::vector<char>* output_arena() = 0;
+    virtual void commit() = 0;
+
+    virtual ~socket_wrapper_base() {}
 };
 
+namespace details
+{
+
+template <typename S>
+inline auto output_arena(S& s, int) -> decltype(s.output_arena())
+{
+    return s.output_arena();
+}
+
+template <typename S>
+inline std::vector<char>* output_arena(S&, long) { return 0; }
+
+template <typename S>
+inline auto commit(S& s, int) -> decltype(s.commit())
+{
+    return s.commit();
+}
+
+template <typename S>
+inline void commit(S&, long) {}
+
+}
+
 template <typename SocketType>
 class socket_wrapper : public socket_wrapper_base
 {
@@ -24,34 +57,11 @@ public:
 
     int read (      char* data, int size) { return socket.read (data, size); }
     int write(const char* data, int size) { return socket.write(data, size); }
-};
-
-// additional type traits
-
-template <typename T>
-struct is_constant_size : std::is_fundamental<T> {};
-
-template <typename T, T C>
-struct is_constant_size <std::integral_constant<T, C>> : std::true_type {};
-
-template <typename Key, typename Data>
-struct is_constant_size<pair<Key, Data>>: is_constant_size<Data> {};
-
-template <typename V, typename U>
-struct is_constant_size<phis_value<V, U>>: is_constant_size<V> {};
 
-template <typename Head, typename ...Tail>
-struct is_constant_size<std::tuple<Head, Tail...>> :
-std::integral_constant
-<
-    bool,
-    is_constant_size<         Head    >::value &&
-    is_constant_size<std::tuple<Tail...>>::value
->
-{};
+    std::vector<char>* output_arena() { return details::output_arena(socket, 0); }
 
-template <>
-struct is_constant_size<std::tuple<>> : std::true_type {};
+    void commit() { details::commit(socket, 0); }
+};
 
 // empty dst
 
@@ -69,32 +79,103 @@ class connection
 {
     std::shared_ptr<socket_wrapper_base> socket;
 
+    // reused between messages: no allocations after warm up
+    std::vector<char> rx; // receive arena
+    std::vector<char> tx; // send arena (sockets without write_buffer)
+
+    // writes may come from several threads (device thread, protocol thread)
+    std::recursive_mutex write_m;
+    using lock_t = std::lock_guard<std::recursive_mutex>;
+
+    size_t tx_pending;   // bytes in tx, not sent yet
+    size_t batch_depth;  // write_batch nesting
+    bool broken;         // write failed, stream framing is lost
+
+    static char* reserve(std::vector<char>& arena, size_t size)
+    {
+        if(arena.size() < size)
+            arena.resize(size);
+        return arena.data();
+    }
+
+    // socket write continues short writes: less data is an error,
+    // rest of output is dropped
+    void flush_pending()
+    {
+        if(tx_pending == 0)
+            return;
+
+        int n = broken ? -1 : socket->write(tx.data(), tx_pending);
+
+        if(n > 0)
+            metrics::bytes_out(n);
+
+        if(n < 0 || size_t(n) != tx_pending)
+            broken = true;
+
+        tx_pending = 0;
+    }
+
+    void check_broken() const
+    {
+        if(broken)
+            throw std::runtime_error("error: connection write failed");
+    }
 public:
+    // sent without batch boundary when exceeded
+    enum { MAX_BATCH_SIZE = 1 << 16 };
+
     template <typename S>
-    connection(const S& s): socket(new socket_wrapper<S>(s)) {}
+    connection(const S& s):
+        socket(new socket_wrapper<S>(s)),
+        tx_pending(0),
+        batch_depth(0),
+        broken(false)
+    {}
+
+    connection(const connection&) = delete;
+    connection& operator=(const connection&) = delete;
 
     template <typename T>
     void read(T& t)
     {
         static_assert
         (
-            is_constant_size<std::tuple<T>>::value,
+            is_constant_size<T>::value,
             "size of parameter is not compile time constant"
         );
 
-        read(calc_size(t), t);
+        read(static_size<T>::value, t);
     }
 
     template <typename T>
     void read(size_t size, T& t)
     {
         if(size != 0) {
-            binary_buffer buffer = read_buffer(size);
-            binary_istream is(buffer);
+            binary_istream is = read_stream(size);
             deserialize(is, t);
         }
     }
 
+    // stream over received data, valid until next read
+    binary_istream read_stream(size_t size)
+    {
+        char* data = reserve(rx, size);
+
+        size_t byte_readed = 0;
+
+        if(size != 0)
+            byte_readed = socket->read(data, size);
+
+        if(byte_readed <= size) // not an error code
+            metrics::bytes_in(byte_readed);
+
+        if(byte_readed != size)
+            ; // TODO exc
+
+        return binary_istream(data, size);
+    }
+
     binary_buffer read_buffer(size_t size)
     {
         binary_buffer buffer(size);
@@ -104,18 +185,95 @@ public:
         if(size != 0)
             byte_readed = socket->read((char*)(buffer.data), size);
 
+        if(byte_readed <= size) // not an error code
+            metrics::bytes_in(byte_readed);
+
         if(byte_readed != size)
             ; // TODO exc
 
         return buffer;
     }
 
+    // sent immediately or at the end of current write_batch
     template <typename T>
     void write(const T& t)
     {
-        binary_buffer buffer(make_buffer(t));
-        socket->write((const char*)(buffer.data), buffer.size);
+        write_stream([&t](binary_ostream& os) { os << t; });
     }
+
+    // single pass: f(binary_ostream&) serializes data directly into
+    // send buffer, size is not calculated before
+    template <typename F>
+    void write_stream(const F& f)
+    {
+        lock_t lock(write_m);
+
+        std::vector<char>* arena = socket->output_arena();
+
+        if(arena) { // socket is buffered itself
+            size_t offset = arena->size();
+            binary_ostream os(*arena, offset);
+
+            try {
+                f(os);
+            }
+            catch(...) { // no partial data in queue
+                arena->resize(offset);
+                throw;
+            }
+
+            arena->resize(offset + os.pos());
+            socket->commit();
+            return;
+        }
+
+        binary_ostream os(tx, tx_pending);
+        f(os);
+        tx_pending += os.pos();
+
+        if(batch_depth == 0 || tx_pending > MAX_BATCH_SIZE)
+            flush_pending();
+
+        check_broken();
+    }
+
+    void flush()
+    {
+        lock_t lock(write_m);
+        flush_pending();
+        check_broken();
+    }
+
+    // failed write of batch end is thrown by next write or flush
+    bool is_broken() const { return broken; }
+
+    // message group boundaries, see write_batch
+    void batch_begin()
+    {
+        write_m.lock();
+        ++batch_depth;
+    }
+
+    // no throw: called by write_batch destructor
+    void batch_end()
+    {
+        if(--batch_depth == 0)
+            flush_pending();
+        write_m.unlock();
+    }
+};
+
+// messages written during batch lifetime go in one send
+
+class write_batch
+{
+    connection& c;
+public:
+    write_batch(connection& cn): c(cn) { c.batch_begin(); }
+    ~write_batch() { c.batch_end(); }
+
+    write_batch(const write_batch&) = delete;
+    write_batch& operator=(const write_batch&) = delete;
 };
 
 }
@@ -2,15 +2,18 @@
 #define __DATA_TYPES_H__
 
 #include <cstdint>   // uint8_t ...
-#include <cstring>   // size_t
+#include <cstring>   // size_t, std::memcpy
 #include <cmath>     // pow
 #include <iostream>  // std::ostream
 
 #include <tuple>     // std::tuple
 #include <memory>    // std::shared_ptr
+#include <new>       // placement new
+#include <cstddef>   // std::max_align_t
+#include <type_traits> // std::aligned_storage
 #include <vector>    // std::vector
 #include <array>     // std::array
-#include <algorithm> // std::copy
+#include <algorithm> // std::copy, std::reverse
 #include <stdexcept> // std::logic_error, std::out_of_range
 
 namespace robot {
@@ -103,20 +106,6 @@ public:
     }
 };
 
-template <typename T>
-inline size_t calc_size(const T& t)
-{
-    size_calc_stream s;
-    s << t;
-    return s.get();
-}
-
-template <typename Head, typename ...Tail>
-inline size_t calc_size(const Head& head, const Tail&... tail)
-{
-    return calc_size(head) + calc_size(tail...);
-}
-
 struct binary_buffer
 {
     const size_t size;
@@ -137,31 +126,146 @@ struct binary_buffer
     ~binary_buffer() { delete [] data; }
 };
 
+// little endian load / store: memcpy, no unaligned type punned access
+
+namespace details
+{
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+constexpr bool host_little_endian = false;
+#else
+constexpr bool host_little_endian = true;
+#endif
+
+inline void byte_swap(char* p, size_t size)
+{
+    std::reverse(p, p + size);
+}
+
+template <typename T>
+inline void store_le(char* dst, const T& t)
+{
+    std::memcpy(dst, &t, sizeof(T));
+    if(!host_little_endian)
+        byte_swap(dst, sizeof(T));
+}
+
+template <typename T>
+inline T load_le(const char* src)
+{
+    char tmp[sizeof(T)];
+    std::memcpy(tmp, src, sizeof(T));
+    if(!host_little_endian)
+        byte_swap(tmp, sizeof(T));
+
+    T t;
+    std::memcpy(&t, tmp, sizeof(T));
+    return t;
+}
+
+// spans of arithmetic values: one copy on little endian hosts
+template <typename T>
+inline void store_le(char* dst, const T* src, size_t n)
+{
+    std::memcpy(dst, src, n * sizeof(T));
+    if(!host_little_endian)
+        for(size_t i = 0; i < n; i++)
+            byte_swap(dst + i * sizeof(T), sizeof(T));
+}
+
+template <typename T>
+inline void load_le(T* dst, const char* src, size_t n)
+{
+    std::memcpy(dst, src, n * sizeof(T));
+    if(!host_little_endian)
+        for(size_t i = 0; i < n; i++)
+            byte_swap((char*)(dst + i), sizeof(T));
+}
+
+}
+
+// streams work over any memory: binary_buffer or connection arenas
+
 class binary_stream_base
 {
-    binary_buffer& buffer;
 protected:
+    char *begin;
+    char *end;
     char *ptr;
 
     template <typename T>
-    void check_overflow()
+    void check_overflow(size_t n = 1)
     {
-        if(ptr - buffer.data + sizeof(T) > buffer.size)
+        if(size_t(end - ptr) / sizeof(T) < n)
             throw std::out_of_range("error: bin stream buffer out of range");
     }
 
     binary_stream_base(binary_buffer& b) :
-        buffer(b),
-        ptr(buffer.data)
+        begin(b.data),
+        end(b.data + b.size),
+        ptr(begin)
+    {}
+
+    binary_stream_base(char* data, size_t size) :
+        begin(data),
+        end(data + size),
+        ptr(begin)
     {}
 public:
-    const binary_buffer& get() const { return buffer; }
+    size_t pos() const { return ptr - begin; } // bytes processed
+    size_t size() const { return end - begin; }
 };
 
 class binary_ostream : public binary_stream_base
 {
+    std::vector<char>* arena; // growable mode
+
+    void grow(size_t n) // bytes
+    {
+        size_t offset = begin - arena->data();
+        size_t p = ptr - begin;
+        size_t need = offset + p + n;
+
+        arena->resize(std::max(need, 2 * arena->size()));
+
+        begin = arena->data() + offset;
+        end   = arena->data() + arena->size();
+        ptr   = begin + p;
+    }
+
+    template <typename T>
+    void reserve(size_t n = 1)
+    {
+        if(size_t(end - ptr) / sizeof(T) >= n)
+            return;
+
+        if(!arena)
+            throw std::out_of_range("error: bin stream buffer out of range");
+
+        grow(n * sizeof(T));
+    }
 public:
-    binary_ostream(binary_buffer& b) : binary_stream_base(b) {}
+    binary_ostream(binary_buffer& b) : binary_stream_base(b), arena(0) {}
+
+    binary_ostream(char* data, size_t size) :
+        binary_stream_base(data, size),
+        arena(0)
+    {}
+
+    // growable: writes from offset of arena, arena is resized when needed,
+    // so serialized size is not calculated before; arena size is not
+    // exact after writing, data ends at offset + pos()
+    binary_ostream(std::vector<char>& a, size_t offset = 0) :
+        binary_stream_base(0, 0),
+        arena(&a)
+    {
+        if(a.size() < offset)
+            a.resize(offset);
+
+        begin = a.data() + offset;
+        end   = a.data() + a.size();
+        ptr   = begin;
+    }
 
     template <typename T>
     typename
@@ -172,17 +276,51 @@ public:
     >::type
     operator << (const T& t)
     {
-        check_overflow<T>();
-        *(T*)(ptr) = t; // TODO big endian
+        reserve<T>();
+        details::store_le(ptr, t);
         ptr += sizeof(T);
         return *this;
     }
+
+    // bulk write, one bounds check
+    template <typename T>
+    void write(const T* data, size_t n)
+    {
+        static_assert(std::is_arithmetic<T>::value, "arithmetic type expected");
+
+        reserve<T>(n);
+        details::store_le(ptr, data, n);
+        ptr += n * sizeof(T);
+    }
+
+    // overwrite already written value at position, e.g. size field
+    template <typename T>
+    void patch(size_t at, const T& t)
+    {
+        static_assert(std::is_arithmetic<T>::value, "arithmetic type expected");
+
+        if(at + sizeof(T) > pos())
+            throw std::out_of_range("error: bin stream patch out of range");
+
+        details::store_le(begin + at, t);
+    }
+
+    // already written bytes from position, e.g. for check sums,
+    // valid until next write
+    const char* written(size_t at) const
+    {
+        if(at > pos())
+            throw std::out_of_range("error: bin stream position out of range");
+
+        return begin + at;
+    }
 };
 
 class binary_istream : public binary_stream_base
 {
 public:
     binary_istream(binary_buffer& b) : binary_stream_base(b) {}
+    binary_istream(char* data, size_t size) : binary_stream_base(data, size) {}
 
     template <typename T>
     typename
@@ -195,20 +333,55 @@ public:
     operator >> (T& t)
     {
         check_overflow<T>();
-        t = *(T*)(ptr); // TODO big endian
+        t = details::load_le<T>(ptr);
         ptr += sizeof(T);
         return *this;
     }
+
+    // bulk read, one bounds check
+    template <typename T>
+    void read(T* data, size_t n)
+    {
+        static_assert(std::is_arithmetic<T>::value, "arithmetic type expected");
+
+        check_overflow<T>(n);
+        details::load_le(data, ptr, n);
+        ptr += n * sizeof(T);
+    }
+
+    // checked span of n bytes, decoded by unchecked_istream
+    const char* take(size_t n)
+    {
+        check_overflow<char>(n);
+        const char* p = ptr;
+        ptr += n;
+        return p;
+    }
 };
 
-template <typename T>
-inline binary_buffer make_buffer(const T& t)
+// decoding of already validated span: no bounds checks
+
+class unchecked_istream
 {
-    binary_buffer buf(calc_size(t));
-    binary_ostream os(buf);
-    os << t;
-    return buf;
-}
+    const char* ptr;
+public:
+    unchecked_istream(const char* p) : ptr(p) {}
+
+    template <typename T>
+    typename
+    std::enable_if
+    <
+        std::is_arithmetic<T>::value &&
+        !std::is_const<T>::value,
+        unchecked_istream&
+    >::type
+    operator >> (T& t)
+    {
+        t = details::load_le<T>(ptr);
+        ptr += sizeof(T);
+        return *this;
+    }
+};
 
 ///////////////////////////////////////////////////////////
 //
@@ -266,6 +439,14 @@ inline IStream& operator >> (IStream& is, std::integral_constant<T, C>& t)
 //
 ///////////////////////////////////////////////////////////
 
+// forward declarations for nested tuples lookup
+
+template <typename OStream, typename ...T>
+inline OStream& operator << (OStream& os, const std::tuple<T...>& t);
+
+template <typename IStream, typename ...T>
+inline IStream& operator >> (IStream& is, std::tuple<T...>& t);
+
 // array
 
 template <typename OStream, typename T, size_t C>
@@ -284,6 +465,26 @@ inline IStream& operator >> (IStream& is, std::array<T, C>& t)
     return is;
 }
 
+// arithmetic arrays: bulk copy
+
+template <typename T, size_t C>
+inline
+typename std::enable_if<std::is_arithmetic<T>::value, binary_ostream&>::type
+operator << (binary_ostream& os, const std::array<T, C>& t)
+{
+    os.write(t.data(), C);
+    return os;
+}
+
+template <typename T, size_t C>
+inline
+typename std::enable_if<std::is_arithmetic<T>::value, binary_istream&>::type
+operator >> (binary_istream& is, std::array<T, C>& t)
+{
+    is.read(t.data(), C);
+    return is;
+}
+
 // vector serialization
 
 template <typename OStream, typename T>
@@ -302,6 +503,90 @@ inline IStream& operator >> (IStream& is, std::vector<T>& t)
     return is;
 }
 
+// arithmetic vectors: bulk copy (vector<bool> has no data)
+
+template <typename T>
+using is_bulk_vector_element =
+std::integral_constant
+<
+    bool,
+    std::is_arithmetic<T>::value && !std::is_same<T, bool>::value
+>;
+
+template <typename T>
+inline
+typename std::enable_if<is_bulk_vector_element<T>::value, binary_ostream&>::type
+operator << (binary_ostream& os, const std::vector<T>& t)
+{
+    os.write(t.data(), t.size());
+    return os;
+}
+
+template <typename T>
+inline
+typename std::enable_if<is_bulk_vector_element<T>::value, binary_istream&>::type
+operator >> (binary_istream& is, std::vector<T>& t)
+{
+    is.read(t.data(), t.size());
+    return is;
+}
+
+// span: values in memory owned by other object, serialized as vector
+
+template <typename T>
+class value_span
+{
+    T* ptr;
+    size_t count;
+public:
+    using value_type = T;
+
+    value_span() : ptr(0), count(0) {}
+    value_span(T* p, size_t n) : ptr(p), count(n) {}
+
+    T* data() const { return ptr; }
+    size_t size() const { return count; }
+
+    T& operator[](size_t i) const { return ptr[i]; }
+
+    T* begin() const { return ptr; }
+    T* end() const { return ptr + count; }
+};
+
+template <typename OStream, typename T>
+inline OStream& operator << (OStream& os, const value_span<T>& t)
+{
+    for(const auto& p : t)
+        os << p;
+    return os;
+}
+
+template <typename IStream, typename T>
+inline IStream& operator >> (IStream& is, value_span<T>& t)
+{
+    for(auto& p : t)
+        is >> p;
+    return is;
+}
+
+template <typename T>
+inline
+typename std::enable_if<std::is_arithmetic<T>::value, binary_ostream&>::type
+operator << (binary_ostream& os, const value_span<T>& t)
+{
+    os.write(t.data(), t.size());
+    return os;
+}
+
+template <typename T>
+inline
+typename std::enable_if<std::is_arithmetic<T>::value, binary_istream&>::type
+operator >> (binary_istream& is, value_span<T>& t)
+{
+    is.read(t.data(), t.size());
+    return is;
+}
+
 // repeat
 
 template <typename SizeType, typename T>
@@ -318,11 +603,41 @@ inline OStream& operator << (OStream& os, const repeat<SizeType, T>& t)
     return os << vec;
 }
 
+template <typename T>
+struct is_constant_size;
+
+template <typename T>
+struct static_size;
+
+namespace details
+{
+
+// least serialized size of one element
+template <typename T, bool CONSTANT = is_constant_size<T>::value>
+struct min_size : std::integral_constant<size_t, 1> {};
+
+template <typename T>
+struct min_size<T, true> : std::integral_constant<size_t, static_size<T>::value> {};
+
+// count from wire is checked before allocation,
+// text streams and validated spans are not limited
+template <typename IStream>
+inline void check_count(IStream&, size_t, size_t) {}
+
+inline void check_count(binary_istream& is, size_t count, size_t elem_size)
+{
+    if(elem_size && (is.size() - is.pos()) / elem_size < count)
+        throw std::out_of_range("error: repeat count out of range");
+}
+
+}
+
 template <typename IStream, typename SizeType, typename T>
 inline IStream& operator >> (IStream& is, repeat<SizeType, T>& t)
 {
     SizeType size = 0;
     is >> size;
+    details::check_count(is, size, details::min_size<T>::value);
     t.resize(size);
     std::vector<T>& vec = t;
     return is >> vec;
@@ -463,82 +778,583 @@ inline const at_key<Key, std::tuple<T...>>& get(const std::tuple<T...>& t)
     return std::get<i>(t).value;
 }
 
+///////////////////////////////////////////////////////////
+//
+//                  serialized size
+//
+///////////////////////////////////////////////////////////
+
+// compile time size of constant size types, no value traversal
+
+template <typename T>
+struct is_constant_size : std::is_arithmetic<T> {};
+
+template <typename T>
+struct static_size : std::integral_constant<size_t, sizeof(T)>
+{
+    static_assert(std::is_arithmetic<T>::value, "size is not compile time constant");
+};
+
+template <typename T, T C>
+struct is_constant_size<std::integral_constant<T, C>> : std::true_type {};
+
+template <typename T, T C>
+struct static_size<std::integral_constant<T, C>> :
+std::integral_constant<size_t, sizeof(T)>
+{};
+
+template <typename Key, typename Data>
+struct is_constant_size<pair<Key, Data>> : is_constant_size<Data> {};
+
+template <typename Key, typename Data>
+struct static_size<pair<Key, Data>> : static_size<Data> {};
+
+template <typename T, size_t C>
+struct is_constant_size<std::array<T, C>> : is_constant_size<T> {};
+
+template <typename T, size_t C>
+struct static_size<std::array<T, C>> :
+std::integral_constant<size_t, C * static_size<T>::value>
+{};
+
+template <>
+struct is_constant_size<std::tuple<>> : std::true_type {};
+
+template <>
+struct static_size<std::tuple<>> : std::integral_constant<size_t, 0> {};
+
+template <typename Head, typename ...Tail>
+struct is_constant_size<std::tuple<Head, Tail...>> :
+std::integral_constant
+<
+    bool,
+    is_constant_size<         Head    >::value &&
+    is_constant_size<std::tuple<Tail...>>::value
+>
+{};
+
+template <typename Head, typename ...Tail>
+struct static_size<std::tuple<Head, Tail...>> :
+std::integral_constant
+<
+    size_t,
+    static_size<         Head    >::value +
+    static_size<std::tuple<Tail...>>::value
+>
+{};
+
+// compile time offset of field in constant size prefix of tuple
+
+namespace details
+{
+
+template <size_t N, typename T>
+struct prefix_size;
+
+template <>
+struct prefix_size<0, std::tuple<>> : std::integral_constant<size_t, 0> {};
+
+template <typename Head, typename ...Tail>
+struct prefix_size<0, std::tuple<Head, Tail...>> :
+std::integral_constant<size_t, 0>
+{};
+
+template <size_t N, typename Head, typename ...Tail>
+struct prefix_size<N, std::tuple<Head, Tail...>> :
+std::integral_constant
+<
+    size_t,
+    static_size<Head>::value +
+    prefix_size<N - 1, std::tuple<Tail...>>::value
+>
+{};
+
+}
+
+template <typename Key, typename T>
+struct static_offset;
+
+template <typename Key, typename ...T>
+struct static_offset<Key, std::tuple<T...>> :
+details::prefix_size<details::key_index<Key, T...>::value, std::tuple<T...>>
+{};
+
+// runtime size: constant size parts are not traversed
+
+namespace details
+{
+
+template <typename T>
+inline constexpr
+typename std::enable_if<is_constant_size<T>::value, size_t>::type
+serialized_size(const T&) { return static_size<T>::value; }
+
+template <typename T>
+inline
+typename std::enable_if<!is_constant_size<T>::value, size_t>::type
+serialized_size(const T& t);
+
+template <typename Key, typename Val>
+inline
+typename std::enable_if<!is_constant_size<Val>::value, size_t>::type
+serialized_size(const pair<Key, Val>& t);
+
+template <typename ...T>
+inline
+typename std::enable_if<!is_constant_size<std::tuple<T...>>::value, size_t>::type
+serialized_size(const std::tuple<T...>& t);
+
+template <typename T, size_t C>
+inline
+typename std::enable_if<!is_constant_size<T>::value, size_t>::type
+serialized_size(const std::array<T, C>& t);
+
+template <typename T>
+inline size_t serialized_size(const std::vector<T>& t);
+
+template <typename SizeType, typename T>
+inline size_t serialized_size(const repeat<SizeType, T>& t);
+
+template <typename T>
+inline size_t serialized_size(const value_span<T>& t);
+
+// elements sum
+
+template <typename C>
+inline
+typename std::enable_if<is_constant_size<typename C::value_type>::value, size_t>::type
+elements_size(const C& t)
+{
+    return t.size() * static_size<typename C::value_type>::value;
+}
+
+template <typename C>
+inline
+typename std::enable_if<!is_constant_size<typename C::value_type>::value, size_t>::type
+elements_size(const C& t)
+{
+    size_t size = 0;
+    for(const auto& p : t)
+        size += serialized_size(p);
+    return size;
+}
+
+template <size_t INDEX, typename ...T>
+inline
+typename std::enable_if<INDEX == sizeof...(T), size_t>::type
+tuple_size(const std::tuple<T...>&) { return 0; }
+
+template <size_t INDEX, typename ...T>
+inline
+typename std::enable_if<INDEX < sizeof...(T), size_t>::type
+tuple_size(const std::tuple<T...>& t)
+{
+    return serialized_size(std::get<INDEX>(t)) + tuple_size<INDEX + 1>(t);
+}
+
+// other types (any): size stream visit
+template <typename T>
+inline
+typename std::enable_if<!is_constant_size<T>::value, size_t>::type
+serialized_size(const T& t)
+{
+    size_calc_stream s;
+    s << t;
+    return s.get();
+}
+
+template <typename Key, typename Val>
+inline
+typename std::enable_if<!is_constant_size<Val>::value, size_t>::type
+serialized_size(const pair<Key, Val>& t)
+{
+    return serialized_size(t.value);
+}
+
+template <typename ...T>
+inline
+typename std::enable_if<!is_constant_size<std::tuple<T...>>::value, size_t>::type
+serialized_size(const std::tuple<T...>& t)
+{
+    return tuple_size<0>(t);
+}
+
+template <typename T, size_t C>
+inline
+typename std::enable_if<!is_constant_size<T>::value, size_t>::type
+serialized_size(const std::array<T, C>& t)
+{
+    return elements_size(t);
+}
+
+template <typename T>
+inline size_t serialized_size(const std::vector<T>& t)
+{
+    return elements_size(t);
+}
+
+template <typename SizeType, typename T>
+inline size_t serialized_size(const repeat<SizeType, T>& t)
+{
+    return sizeof(SizeType) + elements_size(t);
+}
+
+template <typename T>
+inline size_t serialized_size(const value_span<T>& t)
+{
+    return elements_size(t);
+}
+
+}
+
+template <typename T>
+inline size_t calc_size(const T& t)
+{
+    return details::serialized_size(t);
+}
+
+///////////////////////////////////////////////////////////
+//
+//      deserialization: bounds checks of constant parts
+//
+///////////////////////////////////////////////////////////
+
+// constant size sub-objects are validated once, then decoded unchecked;
+// truncated input still throws std::out_of_range
+
+namespace details
+{
+
+// number of constant size elements starting from I
+template <size_t I, typename Tuple, bool = (I < std::tuple_size<Tuple>::value)>
+struct constant_run : std::integral_constant<size_t, 0> {};
+
+template <size_t I, typename Tuple>
+struct constant_run<I, Tuple, true> :
+std::integral_constant
+<
+    size_t,
+    is_constant_size<typename std::tuple_element<I, Tuple>::type>::value ?
+    1 + constant_run<I + 1, Tuple>::value : 0
+>
+{};
+
+// size of N elements starting from I
+template <size_t I, size_t N, typename Tuple>
+struct run_size :
+std::integral_constant
+<
+    size_t,
+    static_size<typename std::tuple_element<I, Tuple>::type>::value +
+    run_size<I + 1, N - 1, Tuple>::value
+>
+{};
+
+template <size_t I, typename Tuple>
+struct run_size<I, 0, Tuple> : std::integral_constant<size_t, 0> {};
+
+template <size_t I, size_t END, typename IStream, typename ...T>
+inline
+typename std::enable_if<I == END, void>::type
+tuple_range_deserialize(IStream&, std::tuple<T...>&) {}
+
+template <size_t I, size_t END, typename IStream, typename ...T>
+inline
+typename std::enable_if<I < END, void>::type
+tuple_range_deserialize(IStream& is, std::tuple<T...>& t)
+{
+    is >> std::get<I>(t);
+    tuple_range_deserialize<I + 1, END>(is, t);
+}
+
+template <size_t I, typename ...T>
+inline
+typename std::enable_if<I == sizeof...(T), void>::type
+checked_tuple_deserialize(binary_istream&, std::tuple<T...>&) {}
+
+template <size_t I, typename ...T>
+inline
+typename
+std::enable_if
+<
+    I < sizeof...(T) && constant_run<I, std::tuple<T...>>::value == 0,
+    void
+>::type
+checked_tuple_deserialize(binary_istream& is, std::tuple<T...>& t);
+
+template <size_t I, typename ...T>
+inline
+typename
+std::enable_if
+<
+    I < sizeof...(T) && constant_run<I, std::tuple<T...>>::value != 0,
+    void
+>::type
+checked_tuple_deserialize(binary_istream& is, std::tuple<T...>& t);
+
+// variable size element
+template <size_t I, typename ...T>
+inline
+typename
+std::enable_if
+<
+    I < sizeof...(T) && constant_run<I, std::tuple<T...>>::value == 0,
+    void
+>::type
+checked_tuple_deserialize(binary_istream& is, std::tuple<T...>& t)
+{
+    is >> std::get<I>(t);
+    checked_tuple_deserialize<I + 1>(is, t);
+}
+
+// run of constant size elements: one check
+template <size_t I, typename ...T>
+inline
+typename
+std::enable_if
+<
+    I < sizeof...(T) && constant_run<I, std::tuple<T...>>::value != 0,
+    void
+>::type
+checked_tuple_deserialize(binary_istream& is, std::tuple<T...>& t)
+{
+    constexpr size_t N = constant_run<I, std::tuple<T...>>::value;
+
+    unchecked_istream u(is.take(run_size<I, N, std::tuple<T...>>::value));
+    tuple_range_deserialize<I, I + N>(u, t);
+
+    checked_tuple_deserialize<I + N>(is, t);
+}
+
+template <typename C>
+inline void elements_deserialize(binary_istream& is, C& t)
+{
+    using T = typename C::value_type;
+
+    unchecked_istream u(is.take(t.size() * static_size<T>::value));
+    for(auto& p : t)
+        u >> p;
+}
+
+}
+
+template <typename ...T>
+inline binary_istream& operator >> (binary_istream& is, std::tuple<T...>& t)
+{
+    details::checked_tuple_deserialize<0>(is, t);
+    return is;
+}
+
+template <typename T, size_t C>
+inline
+typename
+std::enable_if
+<
+    is_constant_size<T>::value && !std::is_arithmetic<T>::value,
+    binary_istream&
+>::type
+operator >> (binary_istream& is, std::array<T, C>& t)
+{
+    details::elements_deserialize(is, t);
+    return is;
+}
+
+// vector and repeat of constant size elements
+template <typename T>
+inline
+typename
+std::enable_if
+<
+    is_constant_size<T>::value && !std::is_arithmetic<T>::value,
+    binary_istream&
+>::type
+operator >> (binary_istream& is, std::vector<T>& t)
+{
+    details::elements_deserialize(is, t);
+    return is;
+}
+
+template <typename Head, typename ...Tail>
+inline size_t calc_size(const Head& head, const Tail&... tail)
+{
+    return calc_size(head) + calc_size(tail...);
+}
+
+template <typename T>
+inline binary_buffer make_buffer(const T& t)
+{
+    binary_buffer buf(calc_size(t));
+    binary_ostream os(buf);
+    os << t;
+    return buf;
+}
+
 ///////////////////////////////////////////////////////////
 //
 //                          any
 //
 ///////////////////////////////////////////////////////////
 
-class storage_base
+// type erased value or reference with stream operations,
+// small values and references are stored in place
+
+namespace details
+{
+
+// one static table per stored type
+struct any_vtable
 {
-public:
-    virtual void write(std::ostream&) const = 0;
-    virtual void read(std::istream&)        = 0;
+    void (*write_text)(const void*, std::ostream&);
+    void (*read_text )(void*, std::istream&);
 
-    virtual void write(binary_ostream&) const = 0;
-    virtual void read(binary_istream&)        = 0;
+    void (*write_bin)(const void*, binary_ostream&);
+    void (*read_bin )(void*, binary_istream&);
 
-    virtual void write(size_calc_stream&) const = 0;
+    void (*write_size)(const void*, size_calc_stream&);
 
-    virtual ~storage_base() {}
+    void (*copy   )(const void* src, void* dst);
+    void (*move   )(void* src, void* dst);
+    void (*destroy)(void*);
 };
 
+// storage policies: value in place, value on heap, reference
+
 template <typename T>
-class storage : public storage_base
+struct any_inline
 {
-    T val;
-public:
-    storage(const T& t) : val(t) {}
+    static T& get(void* b) { return *static_cast<T*>(b); }
 
-    virtual void write(std::ostream& os) const { os << val; }
-    virtual void read (std::istream& is)       { is >> val; }
+    static void create(void* b, const T& t) { new(b) T(t); }
+    static void copy(const void* s, void* d) { create(d, get(const_cast<void*>(s))); }
+    static void move(void* s, void* d) { new(d) T(std::move(get(s))); }
+    static void destroy(void* b) { get(b).~T(); }
+};
 
-    virtual void write(binary_ostream& os) const { os << val; }
-    virtual void read (binary_istream& is)       { is >> val; }
+template <typename T>
+struct any_heap
+{
+    static T*& ptr(void* b) { return *static_cast<T**>(b); }
+    static T& get(void* b) { return *ptr(b); }
 
-    virtual void write(size_calc_stream& calc) const { calc << val; }
+    static void create(void* b, const T& t) { ptr(b) = new T(t); }
+    static void copy(const void* s, void* d) { create(d, get(const_cast<void*>(s))); }
+    static void move(void* s, void* d) { ptr(d) = ptr(s); ptr(s) = nullptr; }
+    static void destroy(void* b) { delete ptr(b); }
 };
 
 template <typename T>
-class storage_ref : public storage_base
+struct any_ref
 {
-    T& val;
-public:
-    storage_ref(T& t) : val(t) {}
+    static T*& ptr(void* b) { return *static_cast<T**>(b); }
+    static T& get(void* b) { return *ptr(b); }
 
-    virtual void write(std::ostream& os) const { os << val; }
-    virtual void read (std::istream& is)       { is >> val; }
+    static void create(void* b, T& t) { ptr(b) = &t; }
+    static void copy(const void* s, void* d) { ptr(d) = ptr(const_cast<void*>(s)); }
+    static void move(void* s, void* d) { ptr(d) = ptr(s); }
+    static void destroy(void*) {}
+};
 
-    virtual void write(binary_ostream& os) const { os << val; }
-    virtual void read (binary_istream& is)       { is >> val; }
+template <typename Policy>
+struct any_ops
+{
+    template <typename Stream>
+    static void write(const void* b, Stream& s) { s << Policy::get(const_cast<void*>(b)); }
+
+    template <typename Stream>
+    static void read(void* b, Stream& s) { s >> Policy::get(b); }
+
+    static const any_vtable table;
+};
 
-    virtual void write(size_calc_stream& calc) const { calc << val; }
+template <typename Policy>
+const any_vtable any_ops<Policy>::table =
+{
+    &any_ops::template write<std::ostream>,
+    &any_ops::template read <std::istream>,
+    &any_ops::template write<binary_ostream>,
+    &any_ops::template read <binary_istream>,
+    &any_ops::template write<size_calc_stream>,
+    &Policy::copy,
+    &Policy::move,
+    &Policy::destroy
 };
 
+}
+
 class any
 {
-    std::shared_ptr<storage_base> value;
 public:
-    template <typename T> any(storage    <T>* t) : value(t) {}
-    template <typename T> any(storage_ref<T>* t) : value(t) {}
+    enum { INLINE_SIZE = 4 * sizeof(void*) };
+
+    template <typename T>
+    using fits_inline =
+    std::integral_constant
+    <
+        bool,
+        sizeof(T) <= INLINE_SIZE &&
+        alignof(T) <= alignof(std::max_align_t) &&
+        std::is_nothrow_move_constructible<T>::value
+    >;
+private:
+    using buffer_t = std::aligned_storage<INLINE_SIZE, alignof(std::max_align_t)>::type;
+
+    const details::any_vtable* vt;
+    buffer_t buf;
+
+    template <typename Policy, typename T>
+    any(Policy, T& t): vt(&details::any_ops<Policy>::table)
+    {
+        Policy::create(&buf, t);
+    }
+
+    template <typename T>
+    friend any make_storage(const T& t);
+
+    template <typename T>
+    friend any make_storage_ref(T& t);
+public:
+    any(const any& a): vt(a.vt) { vt->copy(&a.buf, &buf); }
+    any(any&& a): vt(a.vt) { vt->move(&a.buf, &buf); }
+
+    any& operator=(any a)
+    {
+        vt->destroy(&buf);
+        vt = a.vt;
+        vt->move(&a.buf, &buf);
+        return *this;
+    }
+
+    ~any() { vt->destroy(&buf); }
 
-    template <typename OStream>
-    void write(OStream& os) const { value->write(os); }
+    void write(std::ostream& os) const { vt->write_text(&buf, os); }
+    void read (std::istream& is)       { vt->read_text (&buf, is); }
 
-    template <typename IStream>
-    void read (IStream& is) { value->read (is); }
+    void write(binary_ostream& os) const { vt->write_bin(&buf, os); }
+    void read (binary_istream& is)       { vt->read_bin (&buf, is); }
+
+    void write(size_calc_stream& calc) const { vt->write_size(&buf, calc); }
 };
 
+// copy of value
 template <typename T>
 inline any make_storage(const T& t)
 {
-    return any(new storage<T>(t));
+    using policy =
+    typename std::conditional
+    <
+        any::fits_inline<T>::value,
+        details::any_inline<T>,
+        details::any_heap<T>
+    >::type;
+
+    return any(policy(), t);
 }
 
+// reference to value, value outlives any
 template <typename T>
 inline any make_storage_ref(T& t)
 {
-    return any(new storage_ref<T>(t));
+    return any(details::any_ref<T>(), t);
 }
 
 // any serialization
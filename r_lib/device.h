@@ -3,6 +3,7 @@
 
 #include <array>
 #include "common_protocol.h"
+#include "shared_value.h"
 
 namespace robot
 {
@@ -39,24 +40,24 @@ struct reg_functions;
 template <typename V, typename U>
 struct reg_functions<phis_value<V, U>>
 {
-    using src = std::vector<V>;
+    using src = value_span<V>;
     using type = phis_value<V, U>;
 
     static uint32_t field_count() { return 1; }
 
-    static void read (const type& t, src& v) { v[0] = t.get_value(); }
+    static void read (const type& t, const src& v) { v[0] = t.get_value(); }
     static void write(type& t, const src& v) { t.set_value(v[0]); }
 };
 
 template <typename V, typename U, size_t C>
 struct reg_functions<std::array<phis_value<V, U>, C>>
 {
-    using src = std::vector<V>;
+    using src = value_span<V>;
     using type = std::array<phis_value<V, U>, C>;
 
     static uint32_t field_count() { return C; }
 
-    static void read(const type& t, src& v)
+    static void read(const type& t, const src& v)
     {
         for(size_t i = 0; i < C; i++)
             v[i] = t[i].get_value();
@@ -89,14 +90,12 @@ class reg
     using v_t = reg_val_type<T>;
     using p_t = parameter<ACCESS_FLAGS, v_t>;
 
-    T data;
+    // device and protocol threads: consistent snapshots without locks
+    shared_value<T> data;
 
-    boost::signals2::signal<void()> on_update;
+    callback_list on_update;
 
-    std::mutex m;
-    using lock_t = std::lock_guard<std::mutex>;
-
-    static void check_vec_size(const std::vector<v_t>& v)
+    static void check_vec_size(const value_span<v_t>& v)
     {
         if(v.size() != reg_functions<T>::field_count())
             throw std::out_of_range("error: incorrect parameter size");
@@ -104,23 +103,26 @@ class reg
 public:
     void set(const T& t)
     {
-        lock_t lock(m);
-        data = t;
+        data.store(t);
+
+        metrics::scope_timer m(metrics::REG_ACTION);
         on_update();
     }
 
-    T get() const { return data; }
+    T get() const { return data.load(); }
 
-    void read_parameter_value(std::vector<v_t>& v)
+    void read_parameter_value(const value_span<v_t>& v)
     {
         check_vec_size(v);
-        reg_functions<T>::read(data, v);
+        reg_functions<T>::read(data.load(), v);
     }
 
-    void write_parameter_value(const std::vector<v_t>& v)
+    void write_parameter_value(const value_span<v_t>& v)
     {
         check_vec_size(v);
-        reg_functions<T>::write(data, v);
+        data.update([&v](T& t) { reg_functions<T>::write(t, v); });
+
+        metrics::scope_timer m(metrics::REG_ACTION);
         on_update();
     }
 
@@ -134,11 +136,15 @@ public:
 
         auto p = std::make_shared<p_t>(make_parameter_config(p_code));
 
-        auto r = [this, p]() { this->read_parameter_value (p->val_ref()); };
+        // device thread only notifies, reader takes snapshot itself:
+        // span is not written concurrently with its serialization
+        auto r = [p]() { p->on_update(); };
         auto w = [this, p]() { this->write_parameter_value(p->val_ref()); };
 
-        if(ACCESS_FLAGS & READ_FLAG)
+        if(ACCESS_FLAGS & READ_FLAG) {
+            p->set_value_source([this](const value_span<v_t>& v) { this->read_parameter_value(v); });
             this->add_action(r);
+        }
 
         if(ACCESS_FLAGS & WRITE_FLAG)
             p->add_write_action(w);
@@ -3,6 +3,9 @@
 
 #include "data_types.h"
 #include <iostream>
+#include <limits>
+#include <ratio>
+#include <type_traits>
 
 namespace robot
 {
@@ -90,50 +93,30 @@ struct mul_result_<unit_mask<T0...>, unit_mask<T1...>>
     using type = unit_mask<mul_result<T0, T1>...>;
 };
 
-// basic unit decimical conversion
-// val * 10 ^ Exp1 => val * 10 ^ Exp0
+// unit conversion U1 => U0 is one decimal factor: val0 = val1 * 10 ^ exp,
+// folded at compile time into std::ratio
 
-template <typename ValueType, int8_t Exp0, int8_t Exp1>
-inline typename std::enable_if<(Exp0 > Exp1), ValueType>::type
-exp_convert(const ValueType& v)
-{
-    return v / pow(10, Exp0 - Exp1);
-}
-
-template <typename ValueType, int8_t Exp0, int8_t Exp1>
-inline typename std::enable_if<(Exp0 < Exp1), ValueType>::type
-exp_convert(const ValueType& v)
-{
-    return v * pow(10, Exp1 - Exp0);
-}
-
-template <typename ValueType, int8_t Exp0, int8_t Exp1>
-inline typename std::enable_if<(Exp0 == Exp1), ValueType>::type
-exp_convert(const ValueType& v)
-{
-    return v;
-}
-
-template <typename, typename, typename>
-struct unit_convertor;
+template <typename, typename>
+struct unit_exp;
 
-template <typename ValueType>
-struct unit_convertor<ValueType, unit_mask<>, unit_mask<>>
-{
-    static ValueType convert(const ValueType& v) { return v; }
-};
+template <>
+struct unit_exp<unit_mask<>, unit_mask<>> : std::integral_constant<int, 0> {};
 
 template
 <
-    typename ValueType,
     typename Head0, typename ...Tail0,
     typename Head1, typename ...Tail1
 >
-struct unit_convertor
+struct unit_exp
 <
-    ValueType,
-    unit_mask<Head0, Tail0...>, 
+    unit_mask<Head0, Tail0...>,
     unit_mask<Head1, Tail1...>
+> :
+std::integral_constant
+<
+    int,
+    (Head1::exp - Head0::exp) * Head0::pow +
+    unit_exp<unit_mask<Tail0...>, unit_mask<Tail1...>>::value
 >
 {
     static_assert
@@ -141,33 +124,208 @@ struct unit_convertor
         Head0::pow == Head1::pow,
         "incorrect phisical unit conversion"
     );
+};
+
+namespace details
+{
+
+constexpr intmax_t dec_pow(int n) { return n == 0 ? 1 : 10 * dec_pow(n - 1); }
 
-    static ValueType convert(const ValueType& v)
+template <int Exp>
+struct dec_ratio_
+{
+    static_assert(Exp >= -18 && Exp <= 18, "unit conversion factor overflow");
+    using type = std::ratio<dec_pow(Exp > 0 ? Exp : 0), dec_pow(Exp < 0 ? -Exp : 0)>;
+};
+
+}
+
+template <typename U0, typename U1>
+using unit_factor = typename details::dec_ratio_<unit_exp<U0, U1>::value>::type;
+
+// rounding of inexact conversions to integer types
+enum class rounding
+{
+    toward_zero, // truncation, as integer division
+    nearest,     // half away from zero
+    down,
+    up
+};
+
+namespace details
+{
+
+// quotient of integer division, d > 0
+
+template <rounding R>
+struct int_div;
+
+template <>
+struct int_div<rounding::toward_zero>
+{
+    template <typename T>
+    static T div(T a, T d) { return a / d; }
+};
+
+template <>
+struct int_div<rounding::nearest>
+{
+    template <typename T>
+    static T div(T a, T d)
+    {
+        T q = a / d, r = a % d;
+        if(r > 0 && r >= d - r)
+            return q + 1;
+        if(r < 0 && d + r <= -r)
+            return q - 1;
+        return q;
+    }
+};
+
+template <>
+struct int_div<rounding::down>
+{
+    template <typename T>
+    static T div(T a, T d) { return a / d - (a % d < 0 ? 1 : 0); }
+};
+
+template <>
+struct int_div<rounding::up>
+{
+    template <typename T>
+    static T div(T a, T d) { return a / d + (a % d > 0 ? 1 : 0); }
+};
+
+// floating point value to integer
+
+template <rounding R>
+struct float_round;
+
+template <>
+struct float_round<rounding::toward_zero>
+{
+    template <typename T>
+    static T round(T v) { return std::trunc(v); }
+};
+
+template <>
+struct float_round<rounding::nearest>
+{
+    template <typename T>
+    static T round(T v) { return std::round(v); }
+};
+
+template <>
+struct float_round<rounding::down>
+{
+    template <typename T>
+    static T round(T v) { return std::floor(v); }
+};
+
+template <>
+struct float_round<rounding::up>
+{
+    template <typename T>
+    static T round(T v) { return std::ceil(v); }
+};
+
+inline void cast_overflow()
+{
+    throw std::out_of_range("error: phis_cast overflow");
+}
+
+template <typename V0, typename V1, typename Factor, rounding R, bool Checked>
+struct value_convertor
+{
+    // integers: exact multiply or divide in widest integer type
+    template <typename T0 = V0, typename T1 = V1>
+    static
+    typename
+    std::enable_if
+    <
+        std::is_integral<T0>::value && std::is_integral<T1>::value,
+        V0
+    >::type
+    convert(const V1& v)
     {
-        auto tmp = v;
-
-        constexpr auto pow = Head0::pow;
-        constexpr auto m = (pow >= 0) ? 1 : -1;
-        constexpr auto exp0 = Head0::exp * m;
-        constexpr auto exp1 = Head1::exp * m;
-
-        if(pow >= 0)
-            for(int8_t i = 0; i < pow; ++i)
-                tmp = exp_convert<ValueType, exp0, exp1>(tmp);
-        else
-            for(int8_t i = 0; i > pow; --i)
-                tmp = exp_convert<ValueType, exp0, exp1>(tmp);
-
-        return
-        unit_convertor
+        using w_t =
+        typename
+        std::conditional
         <
-            ValueType,
-            unit_mask<Tail0...>,
-            unit_mask<Tail1...>
-        >::convert(tmp);
+            std::is_signed<V0>::value || std::is_signed<V1>::value,
+            intmax_t,
+            uintmax_t
+        >::type;
+
+        constexpr w_t num = Factor::num;
+        constexpr w_t den = Factor::den;
+        constexpr w_t max = std::numeric_limits<w_t>::max();
+
+        w_t w = v;
+
+        if
+        (
+            Checked && num != 1 &&
+            (w > max / num || (std::is_signed<w_t>::value && w < -(max / num)))
+        )
+            cast_overflow();
+
+        if(num != 1)
+            w *= num;
+        if(den != 1)
+            w = int_div<R>::div(w, den);
+
+        if
+        (
+            Checked &&
+            (
+                w > w_t(std::numeric_limits<V0>::max()) ||
+                w < w_t(std::numeric_limits<V0>::lowest())
+            )
+        )
+            cast_overflow();
+
+        return V0(w);
+    }
+
+    // floating point: one multiply, rounding if result is integer
+    template <typename T0 = V0, typename T1 = V1>
+    static
+    typename
+    std::enable_if
+    <
+        !(std::is_integral<T0>::value && std::is_integral<T1>::value),
+        V0
+    >::type
+    convert(const V1& v)
+    {
+        using f_t = typename std::common_type<V0, V1>::type;
+
+        constexpr f_t k = f_t(Factor::num) / f_t(Factor::den);
+
+        f_t f = f_t(v) * k;
+
+        if(std::is_integral<V0>::value) {
+            f = float_round<R>::round(f);
+
+            if
+            (
+                Checked &&
+                !
+                (
+                    f >= f_t(std::numeric_limits<V0>::lowest()) &&
+                    f <= f_t(std::numeric_limits<V0>::max())
+                )
+            )
+                cast_overflow();
+        }
+
+        return V0(f);
     }
 };
 
+}
+
 // phis value
 
 template <typename ValueType, typename Unit>
@@ -228,14 +386,25 @@ struct dec_factor_<Exp, phis_value<ValueType, Unit>>
 
 // phis value cast
 
-template <typename T0, typename T1>
+template <typename T0, rounding R = rounding::toward_zero, typename T1>
 T0 phis_cast(const T1& p)
 {
     using v_0 = value_type<T0>;
-    using u_0 = unit_type<T0>;
-    using u_1 = unit_type<T1>;
+    using v_1 = value_type<T1>;
+    using f_t = unit_factor<unit_type<T0>, unit_type<T1>>;
 
-    return T0(unit_convertor<v_0, u_0, u_1>::convert(p.get_value()));
+    return T0(details::value_convertor<v_0, v_1, f_t, R, false>::convert(p.get_value()));
+}
+
+// throws std::out_of_range if value does not fit into T0
+template <typename T0, rounding R = rounding::toward_zero, typename T1>
+T0 checked_phis_cast(const T1& p)
+{
+    using v_0 = value_type<T0>;
+    using v_1 = value_type<T1>;
+    using f_t = unit_factor<unit_type<T0>, unit_type<T1>>;
+
+    return T0(details::value_convertor<v_0, v_1, f_t, R, true>::convert(p.get_value()));
 }
 
 // operators
@@ -315,6 +484,105 @@ DEF_UNIT(non_dimentional)
 
 #undef DEF_UNIT
 
+///////////////////////////////////////////////////////////
+//
+//              phis_value range conversion
+//
+///////////////////////////////////////////////////////////
+
+// phis_value is stored as its raw value, so ranges of phis_value
+// (sonar arrays, reg values) are converted as raw value arrays
+
+template <typename V, typename U>
+using is_raw_layout =
+std::integral_constant
+<
+    bool,
+    std::is_standard_layout<phis_value<V, U>>::value &&
+    sizeof(phis_value<V, U>) == sizeof(V)
+>;
+
+static_assert(is_raw_layout<int16_t, basic_units::metre>::value, "phis_value layout");
+static_assert(is_raw_layout<double , basic_units::second>::value, "phis_value layout");
+
+namespace details
+{
+
+// one loop over raw values with constant factor, vectorized by compiler
+template <typename V0, typename V1, typename Factor, rounding R, bool Checked>
+inline void convert_values(const V1* src, V0* dst, size_t n)
+{
+    using conv = value_convertor<V0, V1, Factor, R, Checked>;
+
+    for(size_t i = 0; i < n; i++)
+        dst[i] = conv::convert(src[i]);
+}
+
+template <typename T0, rounding R, bool Checked, typename V1, typename U1>
+inline void range_cast(const phis_value<V1, U1>* src, T0* dst, size_t n)
+{
+    using v_0 = value_type<T0>;
+    using u_0 = unit_type<T0>;
+
+    static_assert
+    (
+        is_raw_layout<v_0, u_0>::value && is_raw_layout<V1, U1>::value,
+        "phis_value is not stored as raw value"
+    );
+
+    convert_values<v_0, V1, unit_factor<u_0, U1>, R, Checked>
+    (
+        reinterpret_cast<const V1*>(src),
+        reinterpret_cast<v_0*>(dst),
+        n
+    );
+}
+
+}
+
+// dst[i] = phis_cast<T0>(src[i]), i < n
+
+template <typename T0, rounding R = rounding::toward_zero, typename V1, typename U1>
+inline void phis_cast(const phis_value<V1, U1>* src, T0* dst, size_t n)
+{
+    details::range_cast<T0, R, false>(src, dst, n);
+}
+
+template <typename T0, rounding R = rounding::toward_zero, typename V1, typename U1>
+inline void checked_phis_cast(const phis_value<V1, U1>* src, T0* dst, size_t n)
+{
+    details::range_cast<T0, R, true>(src, dst, n);
+}
+
+template <typename T0, rounding R = rounding::toward_zero, typename V1, typename U1>
+inline void phis_cast
+(
+    const value_span<phis_value<V1, U1>>& src,
+    const value_span<T0>& dst
+)
+{
+    if(src.size() != dst.size())
+        throw std::out_of_range("error: phis_cast range size mismatch");
+
+    details::range_cast<T0, R, false>(src.data(), dst.data(), src.size());
+}
+
+template <typename T0, rounding R = rounding::toward_zero, typename V1, typename U1, size_t C>
+inline std::array<T0, C> phis_cast(const std::array<phis_value<V1, U1>, C>& src)
+{
+    std::array<T0, C> dst;
+    details::range_cast<T0, R, false>(src.data(), dst.data(), C);
+    return dst;
+}
+
+template <typename T0, rounding R = rounding::toward_zero, typename V1, typename U1, size_t C>
+inline std::array<T0, C> checked_phis_cast(const std::array<phis_value<V1, U1>, C>& src)
+{
+    std::array<T0, C> dst;
+    details::range_cast<T0, R, true>(src.data(), dst.data(), C);
+    return dst;
+}
+
 ///////////////////////////////////////////////////////////
 //
 //              phis_value serialization
@@ -337,6 +605,12 @@ IStream& operator >> (IStream& is, phis_value<V, U>& t)
     return is;
 }
 
+template <typename V, typename U>
+struct is_constant_size<phis_value<V, U>> : is_constant_size<V> {};
+
+template <typename V, typename U>
+struct static_size<phis_value<V, U>> : static_size<V> {};
+
 }
 
 #endif // __DIMENSION_H__
@@ -0,0 +1,419 @@
+#ifndef __METRICS_H__
+#define __METRICS_H__
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <tuple>
+#include <vector>
+
+namespace robot
+{
+namespace metrics
+{
+
+///////////////////////////////////////////////////////////
+//
+//                  hot path metrics
+//
+///////////////////////////////////////////////////////////
+
+// every thread writes its own shard, no shared cache lines and no
+// locked instructions on hot path: owner does relaxed load and store,
+// snapshot reads shards of all threads with relaxed loads
+
+inline void add(std::atomic<uint64_t>& c, uint64_t n = 1)
+{
+    c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+// log-linear buckets (HDR style): exact below 2^SUB_BITS, then
+// 2^(SUB_BITS - 1) buckets per power of two, relative error < 1/16
+
+class histogram
+{
+public:
+    enum { SUB_BITS = 5 };
+    enum { SUB = 1 << SUB_BITS, HALF = SUB / 2 };
+    enum { BUCKETS = SUB + (64 - SUB_BITS) * HALF };
+
+    static size_t index(uint64_t v)
+    {
+        if(v < SUB)
+            return v;
+
+        unsigned shift = 63 - __builtin_clzll(v) - (SUB_BITS - 1);
+        return SUB + (shift - 1) * HALF + ((v >> shift) - HALF);
+    }
+
+    // highest value of bucket
+    static uint64_t upper_bound(size_t i)
+    {
+        if(i < SUB)
+            return i;
+
+        size_t k = i - SUB;
+        unsigned shift = k / HALF + 1;
+        uint64_t m = k % HALF + HALF;
+        return ((m + 1) << shift) - 1;
+    }
+private:
+    std::array<std::atomic<uint64_t>, BUCKETS> buckets;
+    std::atomic<uint64_t> max_value;
+public:
+    histogram(): max_value(0)
+    {
+        for(auto& b : buckets)
+            b.store(0, std::memory_order_relaxed);
+    }
+
+    histogram(const histogram&) = delete;
+    histogram& operator=(const histogram&) = delete;
+
+    // owner thread only
+    void record(uint64_t v)
+    {
+        add(buckets[index(v)]);
+        if(v > max_value.load(std::memory_order_relaxed))
+            max_value.store(v, std::memory_order_relaxed);
+    }
+
+    uint64_t count(size_t i) const { return buckets[i].load(std::memory_order_relaxed); }
+    uint64_t max() const { return max_value.load(std::memory_order_relaxed); }
+};
+
+// recorded values
+
+enum hist_id
+{
+    DECODE,       // message body decoding, ns
+    DISPATCH,     // message processing with reply, ns
+    ENCODE,       // message serialization, ns
+    REG_ACTION,   // reg update callbacks, ns
+    SIP_INTERVAL, // SIP inter-arrival time, us
+    HISTOGRAMS
+};
+
+inline const char* hist_name(size_t id)
+{
+    static const char* names[HISTOGRAMS] =
+    {
+        "decode, ns",
+        "dispatch, ns",
+        "encode, ns",
+        "reg action, ns",
+        "sip interval, us"
+    };
+    return names[id];
+}
+
+// messages are counted per (group, type), others in last cell
+enum { GROUPS = 4, TYPES = 16 };
+
+struct shard
+{
+    std::atomic<uint64_t> bytes_in;
+    std::atomic<uint64_t> bytes_out;
+    std::array<std::array<std::atomic<uint64_t>, TYPES>, GROUPS> messages;
+    std::array<histogram, HISTOGRAMS> hist;
+
+    std::array<uint32_t, HISTOGRAMS> timer_calls; // owner thread only, see scope_timer
+
+    shard(): bytes_in(0), bytes_out(0)
+    {
+        timer_calls.fill(0);
+        for(auto& g : messages)
+            for(auto& c : g)
+                c.store(0, std::memory_order_relaxed);
+    }
+};
+
+// shards outlive their threads: counts of finished workers stay in totals
+
+class registry
+{
+    std::mutex m;
+    std::vector<std::shared_ptr<shard>> shards;
+public:
+    static registry& instance()
+    {
+        static registry r;
+        return r;
+    }
+
+    std::shared_ptr<shard> add_shard()
+    {
+        auto s = std::make_shared<shard>();
+        std::lock_guard<std::mutex> lock(m);
+        shards.push_back(s);
+        return s;
+    }
+
+    template <typename F>
+    void for_each(const F& f)
+    {
+        std::lock_guard<std::mutex> lock(m);
+        for(auto& s : shards)
+            f(*s);
+    }
+};
+
+// plain pointer: no thread_local initialization guard on every access,
+// shard is owned by registry
+inline shard& local()
+{
+    static thread_local shard* s = 0;
+    if(!s)
+        s = registry::instance().add_shard().get();
+    return *s;
+}
+
+// runtime switch, on by default
+inline std::atomic<bool>& enabled_flag()
+{
+    static std::atomic<bool> f(true);
+    return f;
+}
+
+inline bool enabled() { return enabled_flag().load(std::memory_order_relaxed); }
+inline void set_enabled(bool on) { enabled_flag().store(on, std::memory_order_relaxed); }
+
+// clock read costs more than parsing of small message: one of period
+// scope timers of thread measures time, counters are exact
+inline std::atomic<uint32_t>& sample_mask()
+{
+    static std::atomic<uint32_t> m(63);
+    return m;
+}
+
+// period is power of two, 1 - every call
+inline void set_sample_period(uint32_t period)
+{
+    if(period == 0 || (period & (period - 1)) != 0)
+        throw std::invalid_argument("error: sample period is not power of two");
+    sample_mask().store(period - 1, std::memory_order_relaxed);
+}
+
+// recording
+
+inline void bytes_in(size_t n)
+{
+    if(enabled())
+        add(local().bytes_in, n);
+}
+
+inline void bytes_out(size_t n)
+{
+    if(enabled())
+        add(local().bytes_out, n);
+}
+
+inline void message(uint16_t group, uint16_t type)
+{
+    if(!enabled())
+        return;
+
+    if(group >= GROUPS || type >= TYPES) {
+        group = GROUPS - 1;
+        type = TYPES - 1;
+    }
+    add(local().messages[group][type]);
+}
+
+inline void record(hist_id id, uint64_t v)
+{
+    if(enabled())
+        local().hist[id].record(v);
+}
+
+// time of scope in ns, sampled
+
+class scope_timer
+{
+    using clock = std::chrono::steady_clock;
+
+    hist_id id;
+    bool on;
+    clock::time_point start;
+
+    static bool sampled(hist_id i)
+    {
+        if(!enabled())
+            return false;
+        return (local().timer_calls[i]++ & sample_mask().load(std::memory_order_relaxed)) == 0;
+    }
+public:
+    scope_timer(hist_id i): id(i), on(sampled(i))
+    {
+        if(on)
+            start = clock::now();
+    }
+
+    ~scope_timer()
+    {
+        if(on)
+            local().hist[id].record
+            (
+                std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count()
+            );
+    }
+
+    scope_timer(const scope_timer&) = delete;
+    scope_timer& operator=(const scope_timer&) = delete;
+};
+
+// interval between events of one source (owner thread only), us
+
+class interval_meter
+{
+    using clock = std::chrono::steady_clock;
+
+    hist_id id;
+    bool started;
+    clock::time_point last;
+public:
+    interval_meter(hist_id i): id(i), started(false) {}
+
+    void tick()
+    {
+        auto now = clock::now();
+        if(started)
+            record(id, std::chrono::duration_cast<std::chrono::microseconds>(now - last).count());
+        last = now;
+        started = true;
+    }
+
+    // next tick starts new series (link restarted)
+    void reset() { started = false; }
+};
+
+///////////////////////////////////////////////////////////
+//
+//                  snapshot
+//
+///////////////////////////////////////////////////////////
+
+struct summary
+{
+    uint64_t count;
+    uint64_t p50;
+    uint64_t p99;
+    uint64_t max;
+};
+
+struct snapshot
+{
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    std::vector<std::tuple<uint16_t, uint16_t, uint64_t>> messages; // group, type, count; non-zero only
+    std::array<summary, HISTOGRAMS> hist;
+};
+
+// upper bound of bucket of percentile p (0..100)
+inline uint64_t percentile(const std::array<uint64_t, histogram::BUCKETS>& b, uint64_t total, double p)
+{
+    if(total == 0)
+        return 0;
+
+    uint64_t rank = uint64_t(p / 100 * total + 0.5);
+    if(rank == 0)
+        rank = 1;
+
+    uint64_t seen = 0;
+    for(size_t i = 0; i < b.size(); i++) {
+        seen += b[i];
+        if(seen >= rank)
+            return histogram::upper_bound(i);
+    }
+    return histogram::upper_bound(b.size() - 1);
+}
+
+// totals of all threads
+inline snapshot collect()
+{
+    snapshot s = snapshot();
+
+    uint64_t messages[GROUPS][TYPES] = {};
+    std::vector<std::array<uint64_t, histogram::BUCKETS>> buckets(HISTOGRAMS);
+    for(auto& b : buckets)
+        b.fill(0);
+
+    registry::instance().for_each
+    (
+        [&](const shard& sh)
+        {
+            s.bytes_in += sh.bytes_in.load(std::memory_order_relaxed);
+            s.bytes_out += sh.bytes_out.load(std::memory_order_relaxed);
+
+            for(size_t g = 0; g < GROUPS; g++)
+                for(size_t t = 0; t < TYPES; t++)
+                    messages[g][t] += sh.messages[g][t].load(std::memory_order_relaxed);
+
+            for(size_t h = 0; h < HISTOGRAMS; h++) {
+                for(size_t i = 0; i < histogram::BUCKETS; i++)
+                    buckets[h][i] += sh.hist[h].count(i);
+                s.hist[h].max = std::max(s.hist[h].max, sh.hist[h].max());
+            }
+        }
+    );
+
+    for(size_t g = 0; g < GROUPS; g++)
+        for(size_t t = 0; t < TYPES; t++)
+            if(messages[g][t])
+                s.messages.emplace_back(g, t, messages[g][t]);
+
+    for(size_t h = 0; h < HISTOGRAMS; h++) {
+        uint64_t total = 0;
+        for(uint64_t c : buckets[h])
+            total += c;
+
+        // bucket bound may be above recorded values
+        summary& v = s.hist[h];
+        v.count = total;
+        v.p50 = std::min(percentile(buckets[h], total, 50), v.max);
+        v.p99 = std::min(percentile(buckets[h], total, 99), v.max);
+    }
+
+    return s;
+}
+
+// local text dump
+inline void dump(std::ostream& os, const snapshot& s)
+{
+    os << "bytes in  " << s.bytes_in << "\n";
+    os << "bytes out " << s.bytes_out << "\n";
+
+    os << "messages (group, type, count)\n";
+    for(auto& m : s.messages)
+        os << "    " << std::get<0>(m) << " " << std::get<1>(m) << " " << std::get<2>(m) << "\n";
+
+    os << std::left << std::setw(20) << "histogram"
+       << std::right
+       << std::setw(12) << "count"
+       << std::setw(12) << "p50"
+       << std::setw(12) << "p99"
+       << std::setw(12) << "max" << "\n";
+
+    for(size_t h = 0; h < HISTOGRAMS; h++) {
+        const summary& v = s.hist[h];
+        os << std::left << std::setw(20) << hist_name(h)
+           << std::right
+           << std::setw(12) << v.count
+           << std::setw(12) << v.p50
+           << std::setw(12) << v.p99
+           << std::setw(12) << v.max << "\n";
+    }
+}
+
+inline void dump(std::ostream& os) { dump(os, collect()); }
+
+}}
+
+#endif // __METRICS_H__
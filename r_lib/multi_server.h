@@ -0,0 +1,867 @@
+#ifndef __MULTI_SERVER_H__
+#define __MULTI_SERVER_H__
+
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+#include "common_protocol.h"
+#include "session_manager.h"
+#include "subscription.h"
+#include "tcp.h"
+#include "reactor.h"
+
+namespace robot
+{
+
+///////////////////////////////////////////////////////////
+//
+//                        session
+//
+///////////////////////////////////////////////////////////
+
+// one client connection: incremental message framing and output queue,
+// complete messages go to handler of owner
+
+class session
+{
+public:
+    using handler_t =
+    std::function
+    <
+        void(const common_protocol::message_header&, binary_istream&)
+    >;
+
+    // socket for session's server: replies are serialized into output queue
+    class output
+    {
+        session* s;
+    public:
+        output(session* p): s(p) {}
+
+        int read (char*, int) { return 0; } // input is pushed by reactor
+        int write(const char* data, int size) { s->send(data, size); return size; }
+
+        std::vector<char>* output_arena() { return s->closed ? 0 : &s->tx; }
+        void commit() { s->commit(); }
+    };
+private:
+    enum { READ_CHUNK = 4096 };
+    enum { CHUNKS_PER_EVENT = 4 }; // then other sessions and timers run
+
+    tcp_socket socket;
+    reactor& loop;
+
+    // input state: message header, then message body
+    common_protocol::message_header header;
+    bool header_ready;
+    std::vector<char> rx;
+
+    // output state
+    std::vector<char> tx;
+    size_t tx_offset;
+    uint32_t events;
+    bool closed;
+    bool closing; // close after output flush
+
+    handler_t handler;
+
+    std::function<void()> drain_action;  // output queue became empty
+    std::function<void()> flush_request; // owner sends output at batch end
+    bool flush_requested;
+
+    static size_t header_size()
+    {
+        return static_size<common_protocol::message_header>::value;
+    }
+
+    size_t rx_need() const
+    {
+        using namespace common_protocol;
+        return header_ready ? get<data_size_key>(header) : header_size();
+    }
+
+    void update_events()
+    {
+        uint32_t ev = reactor::READ_EVENT;
+        if(tx_offset != tx.size())
+            ev |= reactor::WRITE_EVENT;
+
+        if(ev != events) {
+            loop.modify(socket.handle(), ev);
+            events = ev;
+        }
+    }
+
+    // send as much as socket accepts
+    void flush()
+    {
+        while(tx_offset != tx.size()) {
+            int n = socket.write_some(tx.data() + tx_offset, tx.size() - tx_offset);
+
+            if(n < 0) {
+                if(!would_block())
+                    closed = true;
+                break;
+            }
+
+            tx_offset += n;
+            metrics::bytes_out(n);
+        }
+
+        if(tx_offset == tx.size()) {
+            tx.clear(); // keeps capacity
+            tx_offset = 0;
+        }
+    }
+
+    // parse all complete messages in rx
+    void parse()
+    {
+        size_t offset = 0;
+
+        while(!closing && rx.size() - offset >= rx_need()) {
+            size_t size = rx_need();
+
+            binary_istream is(rx.data() + offset, size);
+            offset += size;
+
+            if(!header_ready) {
+                is >> header;
+                if(get<common_protocol::data_size_key>(header) > MAX_MESSAGE_SIZE)
+                    throw std::out_of_range("error: message is too long");
+                header_ready = true;
+            }
+            else {
+                header_ready = false;
+
+                metrics::message
+                (
+                    get<common_protocol::group_key>(header),
+                    get<common_protocol::type_key>(header)
+                );
+                metrics::scope_timer t(metrics::DISPATCH);
+
+                handler(header, is);
+            }
+        }
+
+        rx.erase(rx.begin(), rx.begin() + offset);
+    }
+public:
+    // max size of unsent data, slow reader is disconnected after overflow
+    enum { MAX_OUTPUT_BACKLOG = 1 << 20 };
+    // committed data sent without waiting for batch end
+    enum { MAX_BATCH_SIZE = 1 << 16 };
+    enum { MAX_MESSAGE_SIZE = 1 << 20 };
+    // max size of received data not parsed yet: one message and read
+    // of one event, pipelining client is disconnected after overflow
+    enum { MAX_INPUT_BACKLOG = MAX_MESSAGE_SIZE + CHUNKS_PER_EVENT * READ_CHUNK };
+
+    // handler is set before first read
+    session(const tcp_socket& s, reactor& r):
+        socket(s),
+        loop(r),
+        header_ready(false),
+        tx_offset(0),
+        events(reactor::READ_EVENT),
+        closed(false),
+        closing(false),
+        flush_requested(false)
+    {}
+
+    session(const session&) = delete;
+    session& operator=(const session&) = delete;
+
+    int handle() const { return socket.handle(); }
+    bool is_closed() const { return closed; }
+
+    size_t backlog() const { return tx.size() - tx_offset; }
+
+    // socket did not accept all output, waiting for write event
+    bool blocked() const { return events & reactor::WRITE_EVENT; }
+
+    output get_output() { return output(this); }
+
+    void set_handler(const handler_t& f) { handler = f; }
+
+    void set_drain_action(const std::function<void()>& f) { drain_action = f; }
+
+    // without flush request output is sent on every commit
+    void set_flush_request(const std::function<void()>& f) { flush_request = f; }
+
+    template <typename Group, typename Type>
+    void send_message
+    (
+        const common_protocol::message_body<Group, Type>& m,
+        uint32_t msg_num = 0
+    )
+    {
+        if(closed)
+            return;
+
+        // serialized in place, no size pass
+        size_t offset = tx.size();
+        binary_ostream os(tx, offset);
+
+        try {
+            metrics::scope_timer t(metrics::ENCODE);
+            common_protocol::write_message<Group, Type>(os, m, msg_num);
+        }
+        catch(...) {
+            tx.resize(offset);
+            throw;
+        }
+
+        tx.resize(offset + os.pos());
+        commit();
+    }
+
+    // stop reading, close after pending output is sent
+    void close_after_flush()
+    {
+        closing = true;
+        send_output();
+    }
+
+    // space for size bytes at the end of output queue, 0 if closed
+    char* reserve(size_t size)
+    {
+        if(closed)
+            return 0;
+
+        size_t old = tx.size();
+        tx.resize(old + size);
+        return tx.data() + old;
+    }
+
+    // reserved data is ready, sent at batch end or when batch is too big
+    void commit()
+    {
+        if(closed)
+            return;
+
+        if(flush_request && backlog() < MAX_BATCH_SIZE) {
+            if(!flush_requested) {
+                flush_requested = true;
+                flush_request();
+            }
+            return;
+        }
+
+        send_output();
+    }
+
+    // batch end: send all committed data socket accepts
+    void send_output()
+    {
+        flush_requested = false;
+
+        if(closed)
+            return;
+
+        flush();
+
+        if(closing && tx_offset == tx.size())
+            closed = true;
+
+        if(closed)
+            return;
+
+        if(backlog() > MAX_OUTPUT_BACKLOG) {
+            closed = true;
+            return;
+        }
+
+        update_events();
+    }
+
+    // queue data, try to send immediately
+    void send(const char* data, size_t size)
+    {
+        char* dst = reserve(size);
+        if(!dst)
+            return;
+
+        std::copy(data, data + size, dst);
+        commit();
+    }
+
+    // level triggered: data left in socket after CHUNKS_PER_EVENT
+    // reads is read on next loop iteration
+    void on_readable()
+    {
+        if(closed || closing)
+            return;
+
+        bool eof = false;
+
+        for(size_t i = 0; i < CHUNKS_PER_EVENT; i++) {
+            size_t old = rx.size();
+            rx.resize(old + READ_CHUNK); // receive arena, keeps capacity
+
+            int n = socket.read_some(rx.data() + old, READ_CHUNK);
+            rx.resize(old + (n > 0 ? n : 0));
+
+            if(n > 0)
+                metrics::bytes_in(n);
+
+            if(n == 0 || (n < 0 && !would_block())) {
+                eof = true;
+                break;
+            }
+
+            if(n < 0)
+                break;
+        }
+
+        // messages received before half-close are answered
+        try {
+            parse();
+        }
+        catch(const std::exception&) { // malformed message, framing is lost
+            closed = true;
+        }
+
+        if(rx.size() > MAX_INPUT_BACKLOG)
+            closed = true;
+
+        if(eof && !closed)
+            close_after_flush();
+    }
+
+    void on_writable()
+    {
+        if(closed)
+            return;
+
+        flush();
+
+        if(closing && tx_offset == tx.size())
+            closed = true;
+
+        if(closed)
+            return;
+
+        update_events();
+
+        if(tx_offset == tx.size() && drain_action)
+            drain_action();
+    }
+
+    void close() { socket.close(); }
+};
+
+///////////////////////////////////////////////////////////
+//
+//                   multi client server
+//
+///////////////////////////////////////////////////////////
+
+class multi_server
+{
+public:
+    using priority_policy_t = std::function<uint8_t(const tcp_socket&)>;
+private:
+    reactor loop;
+    tcp_listener listener;
+
+    std::shared_ptr<robot_state> state;
+    std::unordered_map<int, std::shared_ptr<session>> sessions;
+
+    session_manager slots;
+    priority_policy_t priority_policy;
+
+    periodic_scheduler periodic;
+    change_notifier changes;
+
+    // sessions with output committed during current loop iteration,
+    // sent with one syscall per session at iteration end
+    std::vector<int> unflushed;
+    std::vector<int> flushing; // keeps capacity
+    bool flush_deferred;
+
+    void request_flush(int fd)
+    {
+        unflushed.push_back(fd);
+
+        if(!flush_deferred) {
+            flush_deferred = true;
+            loop.defer([this]() { this->flush_sessions(); });
+        }
+    }
+
+    void flush_sessions()
+    {
+        flush_deferred = false;
+        flushing.swap(unflushed);
+
+        for(int fd : flushing) {
+            auto it = sessions.find(fd);
+            if(it == sessions.end())
+                continue;
+
+            it->second->send_output();
+
+            if(it->second->is_closed())
+                drop(fd);
+        }
+
+        flushing.clear();
+    }
+
+    void on_accept()
+    {
+        while(1) {
+            tcp_socket s = listener.accept_connection();
+            if(s.handle() < 0)
+                break;
+
+            s.set_no_delay();
+
+            int fd = s.handle();
+
+            auto p = std::make_shared<session>(s, loop);
+            sessions[fd] = p;
+
+            // handler refers to session, session owns handler
+            auto h = std::make_shared<session_handler>(*this, *p);
+            p->set_handler
+            (
+                [h](const common_protocol::message_header& header, binary_istream& is)
+                {
+                    common_protocol::message_dispatcher<session_handler>::dispatch(*h, header, is);
+                }
+            );
+
+            p->set_drain_action([this]() { this->changes.flush(); });
+            p->set_flush_request([this, fd]() { this->request_flush(fd); });
+
+            loop.add
+            (
+                fd,
+                reactor::READ_EVENT,
+                [this, fd](uint32_t ev) { this->on_event(fd, ev); }
+            );
+
+            uint16_t code;
+            uint8_t prior = priority_policy ? priority_policy(s) : 0;
+
+            if(!slots.connect(fd, prior, code))
+                disconnect(*p, code);
+        }
+    }
+
+    void disconnect(session& s, uint16_t code)
+    {
+        using namespace common_protocol;
+
+        slots.disconnect(s.handle());
+        s.send_message<service_group_key, disconnect_code_key>(code);
+        s.close_after_flush();
+
+        if(s.is_closed())
+            drop(s.handle());
+    }
+
+    void send_values(session_id id, const common_protocol::function_value_read& m)
+    {
+        using namespace common_protocol;
+
+        auto it = sessions.find(id);
+        if(it == sessions.end())
+            return;
+
+        it->second->send_message<data_access_group_key, function_value_read_key>(m);
+
+        if(it->second->is_closed())
+            drop(id);
+    }
+
+    // messages of one session: server messages, connection slots and
+    // subscriptions; unbound types are answered by server::not_supported
+    class session_handler : public server
+    {
+        friend class common_protocol::message_dispatcher<session_handler>;
+
+        multi_server& srv;
+        session& s;
+
+        using server::on_message;
+        using server::not_supported;
+
+        void reply(const common_protocol::message_header& header, uint16_t code)
+        {
+            using namespace common_protocol;
+            s.send_message
+            <
+                service_group_key,
+                command_return_code_key
+            >(return_code(header, code), get<message_num_key>(header));
+        }
+
+        // readable parameters of request, others are denied
+        template <typename Request>
+        std::vector<uint8_t> readable
+        (
+            const common_protocol::message_header& header,
+            const Request& req
+        )
+        {
+            using namespace common_protocol;
+
+            std::vector<uint8_t> codes;
+            function_value_read_denied denied;
+
+            filter_readable
+            (
+                r,
+                std::get<0>(std::get<0>(req)),
+                std::get<1>(std::get<0>(req)),
+                std::get<1>(req),
+                codes,
+                denied
+            );
+
+            if(!denied.empty())
+                s.send_message
+                <
+                    data_access_group_key,
+                    function_value_read_denied_key
+                >(denied, get<message_num_key>(header));
+
+            return codes;
+        }
+
+        void subscribe_changes
+        (
+            const common_protocol::message_header& header,
+            const common_protocol::function_value_read_on_update_request& req,
+            bool once
+        )
+        {
+            std::vector<uint8_t> codes = readable(header, req);
+
+            if(!codes.empty())
+                srv.changes.subscribe
+                (
+                    s.handle(),
+                    std::get<0>(std::get<0>(req)),
+                    std::get<1>(std::get<0>(req)),
+                    codes,
+                    once
+                );
+        }
+
+        static std::vector<uint8_t> cancel_codes(const common_protocol::function_value_update_cancel& req)
+        {
+            auto& c = std::get<1>(req);
+            return std::vector<uint8_t>(c.begin(), c.end());
+        }
+
+        // service group: connection slots and control levels
+
+        void on_message
+        (
+            common_protocol::message_tag
+            <
+                common_protocol::service_group_key,
+                common_protocol::active_connections_request_key
+            >,
+            const common_protocol::message_header& header,
+            const common_protocol::active_connections_request&
+        )
+        {
+            using namespace common_protocol;
+            s.send_message
+            <
+                service_group_key,
+                active_connections_info_key
+            >(srv.slots.info(), get<message_num_key>(header));
+        }
+
+        void on_message
+        (
+            common_protocol::message_tag
+            <
+                common_protocol::service_group_key,
+                common_protocol::control_level_up_request_key
+            >,
+            const common_protocol::message_header& header,
+            const common_protocol::control_level_up_request&
+        )
+        {
+            reply(header, srv.slots.activate(s.handle(), true));
+        }
+
+        void on_message
+        (
+            common_protocol::message_tag
+            <
+                common_protocol::service_group_key,
+                common_protocol::control_level_activation_request_key
+            >,
+            const common_protocol::message_header& header,
+            const common_protocol::control_level_activation_request&
+        )
+        {
+            reply(header, srv.slots.activate(s.handle(), false));
+        }
+
+        void on_message
+        (
+            common_protocol::message_tag
+            <
+                common_protocol::service_group_key,
+                common_protocol::control_level_deactivation_request_key
+            >,
+            const common_protocol::message_header& header,
+            const common_protocol::control_level_deactivation_request&
+        )
+        {
+            reply(header, srv.slots.deactivate(s.handle()));
+        }
+
+        void on_message
+        (
+            common_protocol::message_tag
+            <
+                common_protocol::service_group_key,
+                common_protocol::disconnect_request_key
+            >,
+            const common_protocol::message_header&,
+            const common_protocol::disconnect_request&
+        )
+        {
+            srv.disconnect(s, common_protocol::DISCONNECT_BY_REQUEST);
+        }
+
+        // data access group: subscriptions
+
+        void on_message
+        (
+            common_protocol::message_tag
+            <
+                common_protocol::data_access_group_key,
+                common_protocol::function_value_read_periodical_request_key
+            >,
+            const common_protocol::message_header& header,
+            const common_protocol::function_value_read_periodical_request& req
+        )
+        {
+            std::vector<uint8_t> codes = readable(header, req);
+
+            if(!codes.empty())
+                srv.periodic.subscribe
+                (
+                    s.handle(),
+                    std::get<0>(std::get<0>(req)),
+                    std::get<1>(std::get<0>(req)),
+                    codes,
+                    std::get<2>(req)
+                );
+        }
+
+        void on_message
+        (
+            common_protocol::message_tag
+            <
+                common_protocol::data_access_group_key,
+                common_protocol::function_value_read_on_update_1_time_request_key
+            >,
+            const common_protocol::message_header& header,
+            const common_protocol::function_value_read_on_update_1_time_request& req
+        )
+        {
+            subscribe_changes(header, req, true);
+        }
+
+        void on_message
+        (
+            common_protocol::message_tag
+            <
+                common_protocol::data_access_group_key,
+                common_protocol::function_value_read_on_update_request_key
+            >,
+            const common_protocol::message_header& header,
+            const common_protocol::function_value_read_on_update_request& req
+        )
+        {
+            subscribe_changes(header, req, false);
+        }
+
+        void on_message
+        (
+            common_protocol::message_tag
+            <
+                common_protocol::data_access_group_key,
+                common_protocol::function_value_update_cancel_key
+            >,
+            const common_protocol::message_header&,
+            const common_protocol::function_value_update_cancel& req
+        )
+        {
+            srv.changes.cancel
+            (
+                s.handle(),
+                std::get<0>(std::get<0>(req)),
+                std::get<1>(std::get<0>(req)),
+                cancel_codes(req)
+            );
+        }
+
+        void on_message
+        (
+            common_protocol::message_tag
+            <
+                common_protocol::data_access_group_key,
+                common_protocol::function_value_periodical_update_cancel_key
+            >,
+            const common_protocol::message_header&,
+            const common_protocol::function_value_periodical_update_cancel& req
+        )
+        {
+            srv.periodic.cancel
+            (
+                s.handle(),
+                std::get<0>(std::get<0>(req)),
+                std::get<1>(std::get<0>(req)),
+                cancel_codes(req)
+            );
+        }
+    public:
+        session_handler(multi_server& m, session& p):
+            server(p.get_output(), m.state),
+            srv(m),
+            s(p)
+        {}
+    };
+
+    void on_event(int fd, uint32_t ev)
+    {
+        auto it = sessions.find(fd);
+        if(it == sessions.end())
+            return;
+
+        std::shared_ptr<session> s = it->second;
+
+        if(ev & reactor::READ_EVENT)
+            s->on_readable();
+
+        if(ev & reactor::WRITE_EVENT)
+            s->on_writable();
+
+        if((ev & reactor::ERROR_EVENT) && !(ev & reactor::READ_EVENT))
+            drop(fd);
+        else if(s->is_closed())
+            drop(fd);
+    }
+
+    void drop(int fd)
+    {
+        auto it = sessions.find(fd);
+        if(it == sessions.end())
+            return;
+
+        slots.disconnect(fd);
+        periodic.cancel(fd);
+        changes.cancel(fd);
+        loop.remove(fd);
+        it->second->close();
+        sessions.erase(it);
+    }
+public:
+    multi_server
+    (
+        uint32_t ip,
+        uint16_t port,
+        const session_limits& limits = session_limits()
+    ):
+        listener(ip, port),
+        state(std::make_shared<robot_state>()),
+        slots(limits),
+        periodic
+        (
+            loop,
+            *state,
+            [this](session_id id, const common_protocol::function_value_read& m)
+            {
+                this->send_values(id, m);
+            }
+        ),
+        changes
+        (
+            loop,
+            *state,
+            [this](session_id id, const common_protocol::function_value_read& m)
+            {
+                this->send_values(id, m);
+            },
+            [this](session_id id)
+            {
+                auto it = this->sessions.find(id);
+                return it != this->sessions.end() && !it->second->blocked();
+            }
+        ),
+        flush_deferred(false)
+    {
+        slots.set_evict_action
+        (
+            [this](int fd, uint16_t code)
+            {
+                auto it = sessions.find(fd);
+                if(it != sessions.end())
+                    this->disconnect(*it->second, code);
+            }
+        );
+
+        loop.add
+        (
+            listener.handle(),
+            reactor::READ_EVENT,
+            [this](uint32_t) { this->on_accept(); }
+        );
+    }
+
+    ~multi_server()
+    {
+        for(auto& p : sessions)
+            p.second->close();
+    }
+
+    reactor& get_reactor() { return loop; }
+    size_t session_count() const { return sessions.size(); }
+
+    session_manager& get_session_manager() { return slots; }
+
+    // priority of new connection, 0 by default
+    void set_priority_policy(const priority_policy_t& f) { priority_policy = f; }
+
+    function_base& get_function_ref(uint16_t f_code, uint16_t f_number)
+    {
+        return state->get_function_ref(f_code, f_number);
+    }
+
+    parameter_slot& parameter_ref
+    (
+        uint16_t f_code,
+        uint16_t f_number,
+        uint8_t p_code
+    )
+    {
+        return state->parameter_ref(f_code, f_number, p_code);
+    }
+
+    void run_once(int timeout_ms = -1) { loop.run_once(timeout_ms); }
+    // functions are configured before, loop thread owns the table
+    void run()
+    {
+        state->freeze();
+        loop.run();
+    }
+    void stop() { loop.stop(); }
+};
+
+}
+
+#endif // __MULTI_SERVER_H__
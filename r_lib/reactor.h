@@ -0,0 +1,203 @@
+#ifndef __REACTOR_H__
+#define __REACTOR_H__
+
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+#include <mutex>
+#include <stdexcept>
+
+#include <unistd.h>
+#include <sys/epoll.h>   // linux only
+#include <sys/eventfd.h>
+
+#include "timer_wheel.h"
+
+namespace robot
+{
+
+///////////////////////////////////////////////////////////
+//
+//                  epoll event loop
+//
+///////////////////////////////////////////////////////////
+
+class reactor
+{
+public:
+    using handler_t = std::function<void(uint32_t)>;
+
+    enum : uint32_t
+    {
+        READ_EVENT  = EPOLLIN,
+        WRITE_EVENT = EPOLLOUT,
+        ERROR_EVENT = EPOLLERR | EPOLLHUP | EPOLLRDHUP
+    };
+private:
+    enum { MAX_EVENTS = 64 };
+
+    int epoll_fd;
+    bool running;
+
+    std::unordered_map<int, handler_t> handlers;
+
+    timer_wheel timers;
+
+    // functions posted from other threads
+    int event_fd;
+    std::mutex post_m;
+    std::vector<std::function<void()>> posted;
+
+    // functions called at the end of loop iteration (loop thread only)
+    std::vector<std::function<void()>> deferred;
+    std::vector<std::function<void()>> deferred_run; // keeps capacity
+
+    void run_deferred()
+    {
+        while(!deferred.empty()) { // deferred function may defer again
+            deferred_run.swap(deferred);
+
+            for(auto& f : deferred_run)
+                f();
+
+            deferred_run.clear();
+        }
+    }
+
+    void run_posted()
+    {
+        uint64_t cnt;
+        while(read(event_fd, &cnt, sizeof(cnt)) > 0);
+
+        std::vector<std::function<void()>> tmp;
+        {
+            std::lock_guard<std::mutex> lock(post_m);
+            tmp.swap(posted);
+        }
+
+        for(auto& f : tmp)
+            f();
+    }
+
+    void ctl(int op, int fd, uint32_t events)
+    {
+        epoll_event ev;
+        ev.events = events;
+        ev.data.fd = fd;
+
+        if(epoll_ctl(epoll_fd, op, fd, &ev) < 0)
+            throw std::runtime_error("error: epoll_ctl failed");
+    }
+public:
+    reactor():
+        epoll_fd(epoll_create1(0)),
+        running(false),
+        event_fd(eventfd(0, EFD_NONBLOCK))
+    {
+        if(epoll_fd < 0 || event_fd < 0)
+            throw std::runtime_error("error: epoll_create failed");
+
+        add(event_fd, READ_EVENT, [this](uint32_t) { this->run_posted(); });
+    }
+
+    reactor(const reactor&) = delete;
+    reactor& operator=(const reactor&) = delete;
+
+    ~reactor()
+    {
+        close(event_fd);
+        close(epoll_fd);
+    }
+
+    // thread safe: f is called from the loop thread
+    void post(const std::function<void()>& f)
+    {
+        {
+            std::lock_guard<std::mutex> lock(post_m);
+            posted.push_back(f);
+        }
+
+        uint64_t one = 1;
+        ssize_t n = write(event_fd, &one, sizeof(one));
+        (void)n; // fails on counter overflow only, loop is woken anyway
+    }
+
+    // not thread safe: f is called after current events and timers,
+    // used to group output of one iteration
+    void defer(const std::function<void()>& f) { deferred.push_back(f); }
+
+    void add(int fd, uint32_t events, const handler_t& h)
+    {
+        ctl(EPOLL_CTL_ADD, fd, events);
+        handlers[fd] = h;
+    }
+
+    void modify(int fd, uint32_t events) { ctl(EPOLL_CTL_MOD, fd, events); }
+
+    void remove(int fd)
+    {
+        epoll_event ev; // non-null for old kernels
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, &ev);
+        handlers.erase(fd);
+    }
+
+    // timers, time in microseconds
+
+    using timer_id = timer_wheel::timer_id;
+
+    timer_id add_timer(uint64_t delay_us, const std::function<void()>& h)
+    {
+        return timers.add(delay_us, h);
+    }
+
+    timer_id add_periodic_timer(uint64_t period_us, const std::function<void()>& h)
+    {
+        return timers.add(period_us, h, true);
+    }
+
+    void cancel_timer(timer_id id) { timers.cancel(id); }
+
+    // wait for events no longer than timeout_ms (-1 - infinite),
+    // then fire expired timers and deferred functions
+    void run_once(int timeout_ms = -1)
+    {
+        epoll_event events[MAX_EVENTS];
+
+        int t = timers.next_timeout_ms();
+        if(t >= 0 && (timeout_ms < 0 || t < timeout_ms))
+            timeout_ms = t;
+
+        if(!deferred.empty()) // deferred outside of the loop
+            timeout_ms = 0;
+
+        int n = epoll_wait(epoll_fd, events, MAX_EVENTS, timeout_ms);
+
+        for(int i = 0; i < n; i++) {
+            // handler may remove itself or other fds
+            auto it = handlers.find(events[i].data.fd);
+            if(it == handlers.end())
+                continue;
+
+            handler_t h = it->second;
+            h(events[i].events);
+        }
+
+        timers.advance();
+
+        run_deferred();
+    }
+
+    void run()
+    {
+        running = true;
+        while(running)
+            run_once();
+    }
+
+    void stop() { running = false; }
+};
+
+}
+
+#endif // __REACTOR_H__
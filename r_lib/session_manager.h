@@ -0,0 +1,255 @@
+#ifndef __SESSION_MANAGER_H__
+#define __SESSION_MANAGER_H__
+
+#include <map>
+#include <functional>
+
+#include "common_protocol.h"
+
+namespace robot
+{
+
+///////////////////////////////////////////////////////////
+//
+//             control / monitor slots table
+//
+///////////////////////////////////////////////////////////
+
+// control level request failures: own codes of this implementation,
+// not defined by protocol.txt, returned in command_return_code (2.1.9)
+// of control level requests only (high bit set: failure)
+constexpr uint16_t CMD_LOW_PRIORITY  = 0x8001;
+constexpr uint16_t CMD_NO_FREE_SLOTS = 0x8002;
+
+struct session_limits
+{
+    uint8_t control_slots;
+    uint8_t min_control_prior; // min priority for control level
+
+    uint8_t monitor_slots;
+    uint8_t min_monitor_prior; // min priority for connection
+
+    session_limits
+    (
+        uint8_t c_slots = 1,
+        uint8_t m_slots = 8,
+        uint8_t c_prior = 0,
+        uint8_t m_prior = 0
+    ):
+        control_slots(c_slots),
+        min_control_prior(c_prior),
+        monitor_slots(m_slots),
+        min_monitor_prior(m_prior)
+    {}
+};
+
+// every connection takes one slot: monitor after connect,
+// control after control level activation
+
+class session_manager
+{
+public:
+    using session_id = int;
+    using evict_t = std::function<void(session_id, uint16_t)>;
+private:
+    struct entry
+    {
+        bool control;
+        uint8_t prior;
+    };
+
+    session_limits limits;
+    std::map<session_id, entry> table;
+
+    evict_t evict; // send disconnect code and close session
+
+    size_t count(bool control) const
+    {
+        size_t n = 0;
+        for(auto& p : table)
+            n += (p.second.control == control);
+        return n;
+    }
+
+    size_t slots(bool control) const
+    {
+        return control ? limits.control_slots : limits.monitor_slots;
+    }
+
+    uint8_t min_prior(bool control) const
+    {
+        return control ? limits.min_control_prior : limits.min_monitor_prior;
+    }
+
+    static uint8_t next_prior(uint8_t p) { return p == 0xFF ? p : p + 1; }
+
+    // min priority to take slot of level, sent in disconnect codes
+    uint8_t needed_prior(bool control)
+    {
+        uint8_t res = min_prior(control);
+
+        if(count(control) >= slots(control)) {
+            auto l = lowest(control);
+            if(l != table.end())
+                res = std::max(res, next_prior(l->second.prior));
+        }
+
+        return res;
+    }
+
+    // lowest priority session of level, table.end() if none
+    std::map<session_id, entry>::iterator lowest(bool control)
+    {
+        auto res = table.end();
+        for(auto it = table.begin(); it != table.end(); ++it)
+            if(it->second.control == control &&
+              (res == table.end() || it->second.prior < res->second.prior))
+                res = it;
+        return res;
+    }
+
+    // free slot of level for session with priority prior,
+    // lower priority session gives its slot if force is set:
+    // lower priority control session swaps to the requester's monitor
+    // slot, lower priority monitor session is evicted
+    bool take_slot(bool control, uint8_t prior, bool force)
+    {
+        using namespace common_protocol;
+
+        if(count(control) < slots(control))
+            return true;
+
+        auto victim = lowest(control);
+        if(!force || victim == table.end() || victim->second.prior >= prior)
+            return false;
+
+        if(control) {
+            victim->second.control = false;
+            return true;
+        }
+
+        session_id id = victim->first;
+        uint8_t code_prior = std::max(min_prior(false), next_prior(victim->second.prior));
+
+        table.erase(victim);
+        if(evict)
+            evict(id, DISCONNECT_LOW_PRIORITY | code_prior);
+
+        return true;
+    }
+public:
+    session_manager(const session_limits& l = session_limits()):
+        limits(l)
+    {}
+
+    void set_evict_action(const evict_t& f) { evict = f; }
+
+    // returns false and disconnect code if connection is refused
+    bool connect(session_id id, uint8_t prior, uint16_t& code)
+    {
+        using namespace common_protocol;
+
+        if(prior < limits.min_monitor_prior) {
+            code = DISCONNECT_LOW_PRIORITY | limits.min_monitor_prior;
+            return false;
+        }
+
+        if(!take_slot(false, prior, true)) {
+            code = DISCONNECT_NO_FREE_SLOTS | needed_prior(false);
+            return false;
+        }
+
+        entry e = { false, prior };
+        table[id] = e;
+        return true;
+    }
+
+    void disconnect(session_id id) { table.erase(id); }
+
+    bool is_connected(session_id id) const { return table.count(id) != 0; }
+
+    bool is_control(session_id id) const
+    {
+        auto it = table.find(id);
+        return it != table.end() && it->second.control;
+    }
+
+    // control_level_activation_request (force = false)
+    // control_level_up_request         (force = true), lower priority
+    // control session is moved to monitor level
+    uint16_t activate(session_id id, bool force)
+    {
+        using namespace common_protocol;
+
+        auto it = table.find(id);
+        if(it == table.end())
+            return CMD_BAD_FORMAT;
+
+        if(it->second.control)
+            return CMD_DONE;
+
+        uint8_t prior = it->second.prior;
+
+        if(prior < limits.min_control_prior)
+            return CMD_LOW_PRIORITY;
+
+        if(!take_slot(true, prior, force))
+            return CMD_NO_FREE_SLOTS;
+
+        table[id].control = true;
+        return CMD_DONE;
+    }
+
+    // control_level_deactivation_request
+    uint16_t deactivate(session_id id)
+    {
+        using namespace common_protocol;
+
+        auto it = table.find(id);
+        if(it == table.end())
+            return CMD_BAD_FORMAT;
+
+        if(!it->second.control)
+            return CMD_DONE;
+
+        if(count(false) >= slots(false))
+            return CMD_NO_FREE_SLOTS;
+
+        it->second.control = false;
+        return CMD_DONE;
+    }
+
+    common_protocol::active_connections_info info() const
+    {
+        using namespace common_protocol;
+
+        uint8_t c_max = 0, c_min = 0xFF, m_max = 0, m_min = 0xFF;
+
+        for(auto& p : table) {
+            uint8_t& max = p.second.control ? c_max : m_max;
+            uint8_t& min = p.second.control ? c_min : m_min;
+            max = std::max(max, p.second.prior);
+            min = std::min(min, p.second.prior);
+        }
+
+        size_t c_count = count(true);
+        size_t m_count = count(false);
+
+        active_connections_info res;
+
+        get<num_of_control_slots_key     >(res) = limits.control_slots;
+        get<num_of_free_control_slots_key>(res) = limits.control_slots - c_count;
+        get<max_control_prior_key        >(res) = c_count ? c_max : 0;
+        get<min_control_prior_key        >(res) = c_count ? c_min : 0;
+        get<num_of_monitor_slots_key     >(res) = limits.monitor_slots;
+        get<num_of_free_monitor_slots_key>(res) = limits.monitor_slots - m_count;
+        get<max_monitor_prior_key        >(res) = m_count ? m_max : 0;
+        get<min_monitor_prior_key        >(res) = m_count ? m_min : 0;
+
+        return res;
+    }
+};
+
+}
+
+#endif // __SESSION_MANAGER_H__
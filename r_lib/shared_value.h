@@ -0,0 +1,145 @@
+#ifndef __SHARED_VALUE_H__
+#define __SHARED_VALUE_H__
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <type_traits>
+
+namespace robot
+{
+
+///////////////////////////////////////////////////////////
+//
+//           value shared between device and protocol
+//
+///////////////////////////////////////////////////////////
+
+// seqlock for trivially copyable values: writers never block readers,
+// readers retry until they get consistent snapshot;
+// value is kept in atomic words, so there is no data race in copying
+
+template <typename T>
+class seqlock_value
+{
+    static_assert(std::is_trivially_copyable<T>::value, "trivially copyable type expected");
+
+    enum { WORDS = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t) };
+
+    std::atomic<uint32_t> seq;
+    std::atomic<uint64_t> words[WORDS];
+
+    std::mutex write_m; // writers only
+
+    void write_words(const T& t)
+    {
+        uint64_t tmp[WORDS] = {};
+        std::memcpy(tmp, &t, sizeof(T));
+
+        uint32_t s = seq.load(std::memory_order_relaxed);
+        seq.store(s + 1, std::memory_order_relaxed); // odd: write in progress
+        std::atomic_thread_fence(std::memory_order_release);
+
+        for(size_t i = 0; i < WORDS; i++)
+            words[i].store(tmp[i], std::memory_order_relaxed);
+
+        seq.store(s + 2, std::memory_order_release);
+    }
+public:
+    seqlock_value(const T& t = T()): seq(0)
+    {
+        for(auto& w : words)
+            w.store(0, std::memory_order_relaxed);
+        write_words(t);
+    }
+
+    seqlock_value(const seqlock_value&) = delete;
+    seqlock_value& operator=(const seqlock_value&) = delete;
+
+    T load() const
+    {
+        uint64_t tmp[WORDS];
+
+        while(1) {
+            uint32_t s0 = seq.load(std::memory_order_acquire);
+
+            if((s0 & 1) == 0) {
+                for(size_t i = 0; i < WORDS; i++)
+                    tmp[i] = words[i].load(std::memory_order_relaxed);
+
+                std::atomic_thread_fence(std::memory_order_acquire);
+
+                if(seq.load(std::memory_order_relaxed) == s0)
+                    break;
+            }
+        }
+
+        T t;
+        std::memcpy(&t, tmp, sizeof(T));
+        return t;
+    }
+
+    void store(const T& t)
+    {
+        std::lock_guard<std::mutex> lock(write_m);
+        write_words(t);
+    }
+
+    // read-modify-write, serialized with other writers
+    template <typename F>
+    void update(const F& f)
+    {
+        std::lock_guard<std::mutex> lock(write_m);
+        T t = load();
+        f(t);
+        write_words(t);
+    }
+};
+
+// other types: copy under mutex
+
+template <typename T>
+class locked_value
+{
+    T value;
+    mutable std::mutex m;
+    using lock_t = std::lock_guard<std::mutex>;
+public:
+    locked_value(const T& t = T()): value(t) {}
+
+    locked_value(const locked_value&) = delete;
+    locked_value& operator=(const locked_value&) = delete;
+
+    T load() const
+    {
+        lock_t lock(m);
+        return value;
+    }
+
+    void store(const T& t)
+    {
+        lock_t lock(m);
+        value = t;
+    }
+
+    template <typename F>
+    void update(const F& f)
+    {
+        lock_t lock(m);
+        f(value);
+    }
+};
+
+template <typename T>
+using shared_value =
+typename std::conditional
+<
+    std::is_trivially_copyable<T>::value,
+    seqlock_value<T>,
+    locked_value<T>
+>::type;
+
+}
+
+#endif // __SHARED_VALUE_H__
@@ -0,0 +1,491 @@
+#ifndef __SUBSCRIPTION_H__
+#define __SUBSCRIPTION_H__
+
+#include <map>
+#include <set>
+#include <list>
+#include <vector>
+#include <mutex>
+#include <memory>
+#include <functional>
+
+#include "common_protocol.h"
+#include "reactor.h"
+
+namespace robot
+{
+
+///////////////////////////////////////////////////////////
+//
+//                  subscription utils
+//
+///////////////////////////////////////////////////////////
+
+using session_id = int;
+
+using value_read_send_t =
+std::function<void(session_id, const common_protocol::function_value_read&)>;
+
+// split requested parameters into readable codes and denied list
+inline void filter_readable
+(
+    robot_state& state,
+    uint16_t f_code,
+    uint16_t f_number,
+    const repeat<uint8_t, std::tuple<uint8_t, uint8_t>>& request,
+    std::vector<uint8_t>& codes,
+    common_protocol::function_value_read_denied& denied
+)
+{
+    for(auto& p : request) {
+        uint8_t p_code = std::get<0>(p);
+
+        if(state.is_readable(f_code, f_number, p_code))
+            codes.push_back(p_code);
+        else
+            denied.push_back(std::tuple<uint8_t, uint8_t>(p_code, 0));
+    }
+}
+
+///////////////////////////////////////////////////////////
+//
+//               periodical value delivery
+//
+///////////////////////////////////////////////////////////
+
+// all periodical subscriptions of all clients, one timer per period
+
+class periodic_scheduler
+{
+    // client, f_code, f_number
+    using f_key = std::tuple<session_id, uint16_t, uint16_t>;
+
+    struct group
+    {
+        reactor::timer_id timer;
+        std::map<f_key, std::set<uint8_t>> subs;
+    };
+
+    reactor& loop;
+    robot_state& state;
+    value_read_send_t send;
+
+    std::map<uint32_t, group> groups; // by period
+
+    void tick(uint32_t period)
+    {
+        auto g = groups.find(period);
+        if(g == groups.end())
+            return;
+
+        using msg_t = std::pair<session_id, common_protocol::function_value_read>;
+        std::vector<msg_t> out;
+
+        // build all messages first: send may cancel subscriptions
+        for(auto& s : g->second.subs) {
+            std::vector<uint8_t> codes(s.second.begin(), s.second.end());
+
+            out.push_back
+            (
+                msg_t
+                (
+                    std::get<0>(s.first),
+                    state.get_read_values
+                    (
+                        std::get<1>(s.first),
+                        std::get<2>(s.first),
+                        codes
+                    )
+                )
+            );
+        }
+
+        for(auto& m : out)
+            send(m.first, m.second);
+    }
+
+    // remove codes (all if empty) of function from group
+    void remove
+    (
+        std::map<uint32_t, group>::iterator g,
+        const f_key& key,
+        const std::vector<uint8_t>& p_codes
+    )
+    {
+        auto it = g->second.subs.find(key);
+        if(it == g->second.subs.end())
+            return;
+
+        if(p_codes.empty())
+            it->second.clear();
+
+        for(uint8_t p : p_codes)
+            it->second.erase(p);
+
+        if(it->second.empty())
+            g->second.subs.erase(it);
+    }
+
+    void drop_empty_groups()
+    {
+        for(auto g = groups.begin(); g != groups.end();) {
+            if(g->second.subs.empty()) {
+                loop.cancel_timer(g->second.timer);
+                g = groups.erase(g);
+            }
+            else
+                ++g;
+        }
+    }
+public:
+    periodic_scheduler(reactor& r, robot_state& s, const value_read_send_t& f):
+        loop(r),
+        state(s),
+        send(f)
+    {}
+
+    periodic_scheduler(const periodic_scheduler&) = delete;
+    periodic_scheduler& operator=(const periodic_scheduler&) = delete;
+
+    ~periodic_scheduler()
+    {
+        for(auto& g : groups)
+            loop.cancel_timer(g.second.timer);
+    }
+
+    // period in microseconds, parameter moves from its previous period
+    void subscribe
+    (
+        session_id id,
+        uint16_t f_code,
+        uint16_t f_number,
+        const std::vector<uint8_t>& p_codes,
+        uint32_t period
+    )
+    {
+        f_key key(id, f_code, f_number);
+
+        for(auto g = groups.begin(); g != groups.end(); ++g)
+            if(g->first != period)
+                remove(g, key, p_codes);
+
+        auto g = groups.find(period);
+
+        if(g == groups.end()) {
+            group n;
+            n.timer =
+            loop.add_periodic_timer
+            (
+                period,
+                [this, period]() { this->tick(period); }
+            );
+            g = groups.insert(std::make_pair(period, n)).first;
+        }
+
+        g->second.subs[key].insert(p_codes.begin(), p_codes.end());
+
+        drop_empty_groups();
+    }
+
+    // function_value_periodical_update_cancel, all parameters if empty
+    void cancel
+    (
+        session_id id,
+        uint16_t f_code,
+        uint16_t f_number,
+        const std::vector<uint8_t>& p_codes
+    )
+    {
+        f_key key(id, f_code, f_number);
+
+        for(auto g = groups.begin(); g != groups.end(); ++g)
+            remove(g, key, p_codes);
+
+        drop_empty_groups();
+    }
+
+    // client disconnect
+    void cancel(session_id id)
+    {
+        for(auto& g : groups)
+            for(auto it = g.second.subs.begin(); it != g.second.subs.end();) {
+                if(std::get<0>(it->first) == id)
+                    it = g.second.subs.erase(it);
+                else
+                    ++it;
+            }
+
+        drop_empty_groups();
+    }
+
+    size_t group_count() const { return groups.size(); }
+};
+
+///////////////////////////////////////////////////////////
+//
+//                 on update value delivery
+//
+///////////////////////////////////////////////////////////
+
+// parameter update signals mark parameters dirty for subscribed clients,
+// dirty parameters of a function go in one message when client's output
+// queue is empty, so updates between flushes are coalesced
+
+class change_notifier
+{
+public:
+    using ready_t = std::function<bool(session_id)>; // output queue is empty
+private:
+    using f_key = std::tuple<uint16_t, uint16_t>;
+    using p_key = std::tuple<uint16_t, uint16_t, uint8_t>;
+
+    // function_value_read_on_update_1_time_request:
+    // sent after all listed parameters are updated
+    struct one_time
+    {
+        session_id id;
+        f_key f;
+        std::set<uint8_t> all;
+        std::set<uint8_t> wait;
+    };
+
+    using dirty_t = std::map<f_key, std::set<uint8_t>>;
+
+    reactor& loop;
+    robot_state& state;
+    value_read_send_t send;
+    ready_t ready;
+
+    // updates may come from device threads
+    std::mutex m;
+    using lock_t = std::lock_guard<std::mutex>;
+
+    std::map<p_key, std::set<session_id>> subs;
+    std::list<one_time> once;
+    std::map<session_id, dirty_t> dirty;
+    std::set<p_key> watched;
+    bool flush_posted;
+
+    // parameter actions outlive notifier
+    std::shared_ptr<change_notifier*> self;
+
+    void on_update(const p_key& k)
+    {
+        lock_t lock(m);
+
+        f_key f(std::get<0>(k), std::get<1>(k));
+        uint8_t p = std::get<2>(k);
+
+        bool marked = false;
+
+        auto s = subs.find(k);
+        if(s != subs.end())
+            for(session_id id : s->second) {
+                dirty[id][f].insert(p);
+                marked = true;
+            }
+
+        for(auto it = once.begin(); it != once.end();) {
+            if(it->f == f && it->wait.erase(p) && it->wait.empty()) {
+                dirty[it->id][f].insert(it->all.begin(), it->all.end());
+                marked = true;
+                it = once.erase(it);
+            }
+            else
+                ++it;
+        }
+
+        if(marked && !flush_posted) {
+            flush_posted = true;
+            loop.post([this]() { this->flush(); });
+        }
+    }
+
+    void watch(const p_key& k)
+    {
+        if(!watched.insert(k).second)
+            return;
+
+        std::weak_ptr<change_notifier*> w = self;
+
+        auto& p = state.parameter_ref(std::get<0>(k), std::get<1>(k), std::get<2>(k));
+        p->add_update_action
+        (
+            [w, k]()
+            {
+                auto s = w.lock();
+                if(s)
+                    (*s)->on_update(k);
+            }
+        );
+    }
+public:
+    change_notifier
+    (
+        reactor& r,
+        robot_state& s,
+        const value_read_send_t& f,
+        const ready_t& rd
+    ):
+        loop(r),
+        state(s),
+        send(f),
+        ready(rd),
+        flush_posted(false),
+        self(std::make_shared<change_notifier*>(this))
+    {}
+
+    change_notifier(const change_notifier&) = delete;
+    change_notifier& operator=(const change_notifier&) = delete;
+
+    // function_value_read_on_update_request (once = false)
+    // function_value_read_on_update_1_time_request (once = true)
+    void subscribe
+    (
+        session_id id,
+        uint16_t f_code,
+        uint16_t f_number,
+        const std::vector<uint8_t>& p_codes,
+        bool is_once
+    )
+    {
+        for(uint8_t p : p_codes)
+            watch(p_key(f_code, f_number, p));
+
+        lock_t lock(m);
+
+        if(is_once) {
+            one_time o;
+            o.id = id;
+            o.f = f_key(f_code, f_number);
+            o.all.insert(p_codes.begin(), p_codes.end());
+            o.wait = o.all;
+            once.push_back(o);
+        }
+        else
+            for(uint8_t p : p_codes)
+                subs[p_key(f_code, f_number, p)].insert(id);
+    }
+
+    // function_value_update_cancel, all parameters if empty
+    void cancel
+    (
+        session_id id,
+        uint16_t f_code,
+        uint16_t f_number,
+        const std::vector<uint8_t>& p_codes
+    )
+    {
+        lock_t lock(m);
+
+        f_key f(f_code, f_number);
+        std::set<uint8_t> codes(p_codes.begin(), p_codes.end());
+
+        auto cancelled =
+        [&](const f_key& k, uint8_t p)
+        {
+            return k == f && (codes.empty() || codes.count(p));
+        };
+
+        for(auto it = subs.begin(); it != subs.end();) {
+            f_key k(std::get<0>(it->first), std::get<1>(it->first));
+
+            if(cancelled(k, std::get<2>(it->first)))
+                it->second.erase(id);
+
+            if(it->second.empty())
+                it = subs.erase(it);
+            else
+                ++it;
+        }
+
+        for(auto it = once.begin(); it != once.end();) {
+            bool all = true;
+            for(uint8_t p : it->all)
+                all = all && cancelled(it->f, p);
+
+            if(it->id == id && all)
+                it = once.erase(it);
+            else
+                ++it;
+        }
+
+        auto d = dirty.find(id);
+        if(d != dirty.end()) {
+            auto fd = d->second.find(f);
+            if(fd != d->second.end()) {
+                for(auto p = fd->second.begin(); p != fd->second.end();)
+                    p = cancelled(f, *p) ? fd->second.erase(p) : ++p;
+                if(fd->second.empty())
+                    d->second.erase(fd);
+            }
+            if(d->second.empty())
+                dirty.erase(d);
+        }
+    }
+
+    // client disconnect
+    void cancel(session_id id)
+    {
+        lock_t lock(m);
+
+        for(auto it = subs.begin(); it != subs.end();) {
+            it->second.erase(id);
+            if(it->second.empty())
+                it = subs.erase(it);
+            else
+                ++it;
+        }
+
+        for(auto it = once.begin(); it != once.end();)
+            it = it->id == id ? once.erase(it) : ++it;
+
+        dirty.erase(id);
+    }
+
+    // send dirty parameters of ready clients, others keep coalescing
+    void flush()
+    {
+        using msg_t = std::pair<session_id, common_protocol::function_value_read>;
+        std::vector<msg_t> out;
+
+        {
+            lock_t lock(m);
+            flush_posted = false;
+
+            for(auto it = dirty.begin(); it != dirty.end();) {
+                if(!ready(it->first)) {
+                    ++it;
+                    continue;
+                }
+
+                for(auto& f : it->second) {
+                    std::vector<uint8_t> codes(f.second.begin(), f.second.end());
+
+                    out.push_back
+                    (
+                        msg_t
+                        (
+                            it->first,
+                            state.get_read_values
+                            (
+                                std::get<0>(f.first),
+                                std::get<1>(f.first),
+                                codes
+                            )
+                        )
+                    );
+                }
+
+                it = dirty.erase(it);
+            }
+        }
+
+        for(auto& msg : out)
+            send(msg.first, msg.second);
+    }
+};
+
+}
+
+#endif // __SUBSCRIPTION_H__
@@ -2,6 +2,7 @@
 #define __TCP__
 
 #include <stdint.h>
+#include <errno.h>
 
 #ifdef __WINDOWS__
     #include <winsock2.h>
@@ -11,31 +12,111 @@
     enum { SHUTDOWN_OPT = SD_BOTH };
 #else
     #include <unistd.h>
+    #include <fcntl.h>
     #include <sys/types.h>
     #include <sys/socket.h>
     #include <netinet/in.h>
+    #include <netinet/tcp.h>
 
     enum { SHUTDOWN_OPT = SHUT_RDWR };
 #endif
 
+#ifndef MSG_NOSIGNAL
+    #define MSG_NOSIGNAL 0
+#endif
+
 namespace robot
 {
 
+inline void socket_close(int s)
+{
+#ifdef __WINDOWS__
+    closesocket(s);
+#else
+    close(s);
+#endif
+}
+
+inline bool set_nonblocking(int s)
+{
+#ifdef __WINDOWS__
+    u_long mode = 1;
+    return ioctlsocket(s, FIONBIO, &mode) == 0;
+#else
+    int flags = fcntl(s, F_GETFL, 0);
+    return flags >= 0 && fcntl(s, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+}
+
+// true if last non-blocking op failed only because it would block
+inline bool would_block()
+{
+#ifdef __WINDOWS__
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+}
+
 class tcp_socket
 {
     int io_socket;
 public:
     tcp_socket(int s): io_socket(s) {}
 
+    int handle() const { return io_socket; }
+
+    // blocking write of all data, short writes are continued
     int write(const char* write_buffer, size_t size)
     {
-        return send(io_socket, write_buffer, size, 0);
+        size_t sent = 0;
+
+        while(sent < size) {
+            int n = send(io_socket, write_buffer + sent, size - sent, MSG_NOSIGNAL);
+
+            if(n < 0 && errno == EINTR)
+                continue;
+
+            if(n <= 0)
+                return sent ? sent : n;
+
+            sent += n;
+        }
+
+        return sent;
     }
 
     int read (char* read_buffer, size_t size)
     {
         return recv(io_socket, read_buffer, size, MSG_WAITALL);
     }
+
+    // non-blocking io, return number of bytes or -1 (see would_block)
+
+    int write_some(const char* write_buffer, size_t size)
+    {
+        return send(io_socket, write_buffer, size, MSG_NOSIGNAL);
+    }
+
+    int read_some(char* read_buffer, size_t size)
+    {
+        return recv(io_socket, read_buffer, size, 0);
+    }
+
+    void set_no_delay()
+    {
+        int flag = 1;
+        setsockopt
+        (
+            io_socket,
+            IPPROTO_TCP,
+            TCP_NODELAY,
+            (const char*)&flag,
+            sizeof(flag)
+        );
+    }
+
+    void close() { socket_close(io_socket); }
 };
 
 inline void tcp_init()
@@ -65,6 +146,52 @@ inline tcp_socket tcp_client(uint32_t ip, uint16_t port)
     return tcp_socket(io_socket);
 }
 
+// true if last non-blocking connect is not finished yet
+inline bool connect_in_progress()
+{
+#ifdef __WINDOWS__
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EINPROGRESS || errno == EINTR;
+#endif
+}
+
+// non-blocking connect, socket -1 on immediate failure; result is known
+// when socket becomes writable, see connect_error
+inline tcp_socket tcp_connect_nonblocking(uint32_t ip, uint16_t port)
+{
+    tcp_init();
+    int io_socket = socket(AF_INET, SOCK_STREAM, 0);
+    if(io_socket < 0)
+        return tcp_socket(-1);
+
+    set_nonblocking(io_socket);
+
+    sockaddr_in addr;
+
+    addr.sin_addr.s_addr = htonl(ip);
+    addr.sin_port = htons(port);
+    addr.sin_family = AF_INET;
+
+    int res = connect(io_socket, (sockaddr*)&addr, sizeof(addr));
+    if(res < 0 && !connect_in_progress()) {
+        socket_close(io_socket);
+        return tcp_socket(-1);
+    }
+
+    return tcp_socket(io_socket);
+}
+
+// 0 if connection is established
+inline int connect_error(int s)
+{
+    int err = 0;
+    socklen_t len = sizeof(err);
+    if(getsockopt(s, SOL_SOCKET, SO_ERROR, (char*)&err, &len) < 0)
+        return -1;
+    return err;
+}
+
 inline tcp_socket wait_for_tcp_connection(uint32_t ip, uint16_t port)
 {
     tcp_init();
@@ -91,15 +218,64 @@ inline tcp_socket wait_for_tcp_connection(uint32_t ip, uint16_t port)
     if(shutdown(listener_socket, SHUTDOWN_OPT) < 0)
         std::cerr << "tcp shutdown error";
 
-#ifdef __WINDOWS__
-    closesocket(listener_socket);
-#else
-    close(listener_socket);
-#endif
+    socket_close(listener_socket);
 
     return tcp_socket(io_socket);
 }
 
+// non-blocking listener for multi-client servers
+
+class tcp_listener
+{
+    int listener_socket;
+public:
+    tcp_listener(uint32_t ip, uint16_t port, int backlog = SOMAXCONN)
+    {
+        tcp_init();
+        listener_socket = socket(AF_INET, SOCK_STREAM, 0);
+        if(listener_socket < 0)
+            std::cerr << "tcp listen error\n"; // TODO exc
+
+        int reuse = 1;
+        setsockopt
+        (
+            listener_socket,
+            SOL_SOCKET,
+            SO_REUSEADDR,
+            (const char*)&reuse,
+            sizeof(reuse)
+        );
+
+        sockaddr_in addr;
+
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(ip);
+
+        if(bind(listener_socket, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+            std::cerr << "tcp bind error\n"; // TODO exc
+
+        listen(listener_socket, backlog);
+        set_nonblocking(listener_socket);
+    }
+
+    tcp_listener(const tcp_listener&) = delete;
+    tcp_listener& operator=(const tcp_listener&) = delete;
+
+    ~tcp_listener() { socket_close(listener_socket); }
+
+    int handle() const { return listener_socket; }
+
+    // returns socket with negative handle if no pending connections
+    tcp_socket accept_connection()
+    {
+        int io_socket = accept(listener_socket, 0, 0);
+        if(io_socket >= 0)
+            set_nonblocking(io_socket);
+        return tcp_socket(io_socket);
+    }
+};
+
 // only for tests!!!
 namespace tcp_test
 {
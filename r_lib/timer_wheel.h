@@ -0,0 +1,195 @@
+#ifndef __TIMER_WHEEL_H__
+#define __TIMER_WHEEL_H__
+
+#include <algorithm>
+#include <cstdint>
+#include <chrono>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+namespace robot
+{
+
+///////////////////////////////////////////////////////////
+//
+//                  hashed timer wheel
+//
+///////////////////////////////////////////////////////////
+
+class timer_wheel
+{
+public:
+    using clock = std::chrono::steady_clock;
+    using handler_t = std::function<void()>;
+    using timer_id = uint64_t;
+private:
+    enum { SLOTS = 256, WORD_BITS = 64, WORDS = SLOTS / WORD_BITS };
+
+    struct timer
+    {
+        uint64_t expire; // tick
+        uint64_t period; // ticks, 0 for single shot
+        handler_t handler;
+    };
+
+    clock::duration resolution;
+    clock::time_point start;
+
+    uint64_t tick; // last processed tick
+    timer_id next_id;
+
+    std::unordered_map<timer_id, timer> timers;
+    std::vector<timer_id> slots[SLOTS]; // cancelled ids are dropped lazily
+    uint64_t used[WORDS];               // bit of non-empty slot
+
+    void mark(size_t slot, bool set)
+    {
+        uint64_t bit = uint64_t(1) << (slot % WORD_BITS);
+        if(set)
+            used[slot / WORD_BITS] |= bit;
+        else
+            used[slot / WORD_BITS] &= ~bit;
+    }
+
+    // ticks from current to nearest non-empty slot, 1..SLOTS:
+    // slot of cancelled or next round timers gives early wake up only
+    uint64_t nearest_slot() const
+    {
+        size_t from = (tick + 1) % SLOTS;
+        size_t w = from / WORD_BITS;
+
+        // first word from bit of next tick, last word up to it
+        for(size_t i = 0; i <= WORDS; i++) {
+            size_t word = (w + i) % WORDS;
+            uint64_t bits = used[word];
+
+            if(i == 0)
+                bits &= ~uint64_t(0) << (from % WORD_BITS);
+            else if(i == WORDS)
+                bits &= ~(~uint64_t(0) << (from % WORD_BITS));
+
+            if(bits) {
+                size_t slot = word * WORD_BITS + __builtin_ctzll(bits);
+                size_t d = (slot + SLOTS - tick % SLOTS) % SLOTS;
+                return d == 0 ? SLOTS : d;
+            }
+        }
+
+        return SLOTS;
+    }
+
+    uint64_t now_tick() const { return (clock::now() - start) / resolution; }
+
+    uint64_t to_ticks(uint64_t us) const
+    {
+        using namespace std::chrono;
+        uint64_t res = duration_cast<microseconds>(resolution).count();
+        uint64_t t = (us + res - 1) / res;
+        return t == 0 ? 1 : t;
+    }
+
+    void schedule(timer_id id, uint64_t expire)
+    {
+        slots[expire % SLOTS].push_back(id);
+        mark(expire % SLOTS, true);
+    }
+
+    void process_tick()
+    {
+        std::vector<timer_id> slot;
+        slot.swap(slots[tick % SLOTS]);
+
+        for(timer_id id : slot) {
+            auto it = timers.find(id);
+            if(it == timers.end())
+                continue;
+
+            timer& t = it->second;
+
+            if(t.expire != tick) { // next rounds
+                schedule(id, t.expire);
+                continue;
+            }
+
+            handler_t h = t.handler; // handler may cancel itself
+
+            if(t.period != 0) {
+                t.expire += t.period;
+                schedule(id, t.expire);
+            }
+            else
+                timers.erase(it);
+
+            h();
+        }
+
+        // reuse slot storage
+        if(slots[tick % SLOTS].empty()) {
+            slot.clear();
+            slots[tick % SLOTS].swap(slot);
+            mark(tick % SLOTS, false);
+        }
+    }
+public:
+    timer_wheel(clock::duration r = std::chrono::milliseconds(1)):
+        resolution(r),
+        start(clock::now()),
+        tick(0),
+        next_id(1)
+    {
+        std::fill(used, used + WORDS, 0);
+    }
+
+    // delay and period in microseconds
+    timer_id add(uint64_t delay_us, const handler_t& h, bool periodic = false)
+    {
+        uint64_t ticks = to_ticks(delay_us);
+
+        timer t = { now_tick() + ticks, periodic ? ticks : 0, h };
+
+        timer_id id = next_id++;
+        timers[id] = t;
+        schedule(id, t.expire);
+
+        return id;
+    }
+
+    void cancel(timer_id id) { timers.erase(id); }
+
+    bool empty() const { return timers.empty(); }
+
+    // ms to next expiration (-1 if no timers), for poll timeout
+    int next_timeout_ms() const
+    {
+        using namespace std::chrono;
+
+        if(timers.empty())
+            return -1;
+
+        uint64_t now = now_tick();
+        uint64_t d = nearest_slot();
+
+        if(tick + d <= now)
+            return 0;
+
+        auto wait = resolution * (tick + d - now);
+        auto ms = duration_cast<milliseconds>(wait).count();
+        return ms == 0 ? 1 : ms;
+    }
+
+    // fire all timers expired up to now
+    void advance()
+    {
+        uint64_t now = now_tick();
+
+        while(tick < now) {
+            ++tick;
+            process_tick();
+        }
+    }
+};
+
+}
+
+#endif // __TIMER_WHEEL_H__
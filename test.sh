@@ -18,12 +18,29 @@ check() {
 }
 
 check data_types.cpp
+check binary_stream.cpp
 check connection.cpp
 check common_protocol.cpp
 check device.cpp
+check multi_server.cpp
+check session_manager.cpp
+check subscription.cpp
+check zero_alloc.cpp
+check robot_state.cpp
+check callback_list.cpp
+check shared_value.cpp
+check phis_cast.cpp
+check sip_view.cpp
+check p2at_checksum.cpp
+check p2at_driver.cpp
+check p2at_gateway.cpp
+check p2at_sim.cpp
+check metrics.cpp
+check timer_wheel.cpp
 
 echo "TEST PASSED"
 
 #MobileSim --map /usr/local/MobileSim/columbia.map --robot p2at&
+#./p2at_sim 8101&  # in-tree stand-in
 $COMPILER $ARGS tests/p2_at_test_new.cpp
 #./a.out&
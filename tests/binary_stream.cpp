@@ -0,0 +1,113 @@
+#include <cassert>
+
+#include "data_types.h"
+
+using namespace robot;
+
+int main()
+{
+    // little endian on wire, unaligned positions
+    {
+        char data[16] = { 0 };
+        binary_ostream os(data, sizeof(data));
+
+        os << uint8_t(0xAA) << uint32_t(0x11223344) << int16_t(-2);
+
+        const uint8_t wire[] = { 0xAA, 0x44, 0x33, 0x22, 0x11, 0xFE, 0xFF };
+        assert(std::equal(wire, wire + sizeof(wire), (uint8_t*)data));
+
+        binary_istream is(data, sizeof(data));
+
+        uint8_t a;
+        uint32_t b;
+        int16_t c;
+        is >> a >> b >> c;
+
+        assert(a == 0xAA && b == 0x11223344 && c == -2);
+    }
+
+    // bulk paths are byte equal to element by element serialization
+    {
+        std::array<uint16_t, 4> arr = {{ 1, 2, 0x0102, 0xFFFF }};
+        repeat<uint8_t, double> rep;
+        rep.push_back(1.5);
+        rep.push_back(-3.25);
+
+        std::tuple<std::array<uint16_t, 4>, repeat<uint8_t, double>> t(arr, rep);
+
+        std::vector<char> bulk;
+        binary_ostream os(bulk);
+        os << t;
+        bulk.resize(os.pos());
+
+        std::vector<char> elem(bulk.size());
+        binary_ostream es(elem.data(), elem.size());
+        for(auto v : arr)
+            es << v;
+        es << uint8_t(2) << 1.5 << -3.25;
+
+        assert(es.pos() == bulk.size());
+        assert(bulk == elem);
+
+        std::tuple<std::array<uint16_t, 4>, repeat<uint8_t, double>> r;
+        binary_istream is(bulk.data(), bulk.size());
+        is >> r;
+
+        assert(std::get<0>(r) == arr);
+        assert(std::get<1>(r).size() == 2 && std::get<1>(r)[1] == -3.25);
+    }
+
+    // one bounds check for whole span
+    {
+        char data[7];
+        std::array<uint16_t, 4> arr;
+
+        binary_istream is(data, sizeof(data));
+
+        bool thrown = false;
+        try {
+            is >> arr;
+        }
+        catch(const std::out_of_range&) {
+            thrown = true;
+        }
+
+        assert(thrown && is.pos() == 0);
+    }
+
+    // constant run of tuple is checked as a whole, variable tail per part
+    {
+        using t = std::tuple<uint32_t, uint16_t, repeat<uint8_t, std::tuple<uint8_t, int16_t>>>;
+
+        t v;
+        std::get<0>(v) = 7;
+        std::get<2>(v).resize(3);
+        std::get<1>(std::get<2>(v)[2]) = -5;
+
+        std::vector<char> data;
+        binary_ostream os(data);
+        os << v;
+        data.resize(os.pos());
+
+        t r;
+        binary_istream is(data.data(), data.size());
+        is >> r;
+        assert(std::get<0>(r) == 7 && std::get<1>(std::get<2>(r)[2]) == -5);
+
+        // truncated input
+        for(size_t n = 0; n < data.size(); n++) {
+            binary_istream is(data.data(), n);
+
+            bool thrown = false;
+            try {
+                is >> r;
+            }
+            catch(const std::out_of_range&) {
+                thrown = true;
+            }
+            assert(thrown);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,50 @@
+#include <cassert>
+#include <thread>
+
+#include "callback_list.h"
+
+using namespace robot;
+
+int main()
+{
+    callback_list l;
+    assert(l.empty());
+    l(); // no callbacks
+
+    int a = 0, b = 0;
+    l.connect([&a]() { a++; });
+    l.connect([&b]() { b += 2; });
+
+    l();
+    assert(a == 1 && b == 2);
+
+    // connect while other thread emits
+    {
+        callback_list c;
+        std::atomic<int> n(0);
+        std::atomic<bool> stop(false);
+
+        c.connect([&n]() { n++; });
+
+        std::thread t
+        (
+            [&]()
+            {
+                while(!stop)
+                    c();
+            }
+        );
+
+        for(int i = 0; i < 100; i++)
+            c.connect([&n]() { n++; });
+
+        stop = true;
+        t.join();
+
+        n = 0;
+        c();
+        assert(n == 101);
+    }
+
+    return 0;
+}
@@ -1,13 +1,139 @@
+#include <algorithm>
+#include <cassert>
+#include <memory>
 #include "common_protocol.h"
 
 using namespace robot;
 
+// peer side buffers: input is prefilled, output is inspected
+
+class test_socket
+{
+    struct state
+    {
+        std::vector<char> in;
+        size_t read_pos = 0;
+        std::vector<char> out;
+    };
+
+    std::shared_ptr<state> s;
+public:
+    test_socket(): s(std::make_shared<state>()) {}
+
+    int read(char* dst, size_t n)
+    {
+        size_t p = std::min(n, s->in.size() - s->read_pos);
+
+        std::copy(s->in.begin() + s->read_pos, s->in.begin() + s->read_pos + p, dst);
+        s->read_pos += p;
+
+        return p;
+    }
+
+    int write(const char* src, size_t n)
+    {
+        s->out.insert(s->out.end(), src, src + n);
+        return n;
+    }
+
+    template <typename Group, typename Type>
+    void put(const common_protocol::message_body<Group, Type>& m, uint32_t msg_num = 0)
+    {
+        size_t offset = s->in.size();
+        binary_ostream os(s->in, offset);
+        common_protocol::write_message<Group, Type>(os, m, msg_num);
+        s->in.resize(offset + os.pos());
+    }
+
+    std::vector<char>& output() { return s->out; }
+};
+
+template <uint8_t FLAGS>
+parameter_config<uint16_t> make_config(uint8_t p_code)
+{
+    using namespace details;
+
+    parameter_config<uint16_t> conf;
+    get<type_key>(get<access_config_key>(conf)) = FLAGS;
+    get<code_key>(get<access_config_key>(conf)) = p_code;
+    get<field_count_key>(get<value_type_config_key>(conf)) = 1;
+    get<field_size_key >(get<value_type_config_key>(conf)) = 1;
+    return conf;
+}
+
 int main()
 {
-    parameter<3, uint16_t> p(parameter_config<uint16_t>(parameter_access_config(3, 0), parameter_access_level_config(0, 0), parameter_value_type_config(1, 1, 0)));
+    parameter<3, uint16_t> p(make_config<3>(7));
+    assert(p.get_p_code() == 7);
+
+    size_t reads = 0, writes = 0;
+    p.add_read_action([&reads]() { ++reads; });
+    p.add_write_action([&writes]() { ++writes; });
+
+    // actions run once after value access
+    p.on_read();
+    p.on_write();
+    assert(reads == 0 && writes == 0);
 
+    p.set_read();
     p.on_read();
+    p.on_read();
+    assert(reads == 1);
+
+    p.set_write();
     p.on_write();
+    assert(writes == 1);
+
+    // no write access
+    parameter<READ_FLAG, uint16_t> r(make_config<READ_FLAG>(8));
+
+    bool thrown = false;
+    try {
+        r.get_value_writer();
+    }
+    catch(const parameter_access_error&) {
+        thrown = true;
+    }
+    assert(thrown);
+
+    // version negotiation: server proposes 0x0000
+    {
+        using namespace common_protocol;
+
+        test_socket sock;
+        server srv(sock);
+
+        sock.put<service_group_key, protocol_version_key>(0x0003, 4);
+        srv.server_package_parse();
+
+        binary_istream is(sock.output().data(), sock.output().size());
+        message<service_group_key, protocol_version_key> m;
+        is >> m;
+        assert(get<message_num_key>(get<header_key>(m)) == 4);
+        assert(get<body_key>(m) == PROTOCOL_VERSION);
+    }
+
+    // notifications of server are not answered by client
+    {
+        using namespace common_protocol;
+
+        test_socket sock;
+        client c(sock);
+
+        sock.put<service_group_key, disconnect_code_key>(DISCONNECT_BY_REQUEST);
+        sock.put<service_group_key, protocol_version_key>(PROTOCOL_VERSION);
+
+        function_value_read_denied denied;
+        denied.push_back(std::tuple<uint8_t, uint8_t>(0, 0));
+        sock.put<data_access_group_key, function_value_read_denied_key>(denied);
+
+        for(size_t i = 0; i < 3; i++)
+            c.client_package_parse();
+
+        assert(c.get_disconnect_code() == DISCONNECT_BY_REQUEST);
+        assert(c.get_peer_version() == PROTOCOL_VERSION);
+        assert(sock.output().empty());
+    }
 
     return 0;
 }
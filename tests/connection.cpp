@@ -1,54 +1,133 @@
 #include <algorithm>
-#include <iostream>
+#include <cassert>
+#include <memory>
+#include <vector>
 #include "connection.h"
 
 using namespace robot;
 
+// loopback: written data is read back, sends are counted
+
 class test_socket
 {
-    char buf[100];
+    struct state
+    {
+        std::vector<char> buf;
+        size_t read_pos = 0;
+        size_t writes = 0;
+        size_t accept = size_t(-1); // bytes accepted until failure
+    };
+
+    std::shared_ptr<state> s;
 public:
-    int read (char* dst, size_t n)
+    test_socket(): s(std::make_shared<state>()) {}
+
+    int read(char* dst, size_t n)
     {
-        size_t p = n > 100 ? 100 : n;
+        size_t p = std::min(n, s->buf.size() - s->read_pos);
 
-        std::copy(buf, buf + p, dst);
+        std::copy(s->buf.begin() + s->read_pos, s->buf.begin() + s->read_pos + p, dst);
+        s->read_pos += p;
 
         return p;
     }
 
     int write(const char* src, size_t n)
     {
-        size_t p = n > 100 ? 100 : n;
-
-        std::copy(src, src + p, buf);
-
-        print();
+        size_t p = std::min(n, s->accept);
+        if(s->accept != size_t(-1))
+            s->accept -= p;
 
-        return p;
+        s->buf.insert(s->buf.end(), src, src + p);
+        ++s->writes;
+        return p ? int(p) : -1;
     }
 
-    void print()
-    {
-        for(size_t i = 0; i < 100; i++)
-            std::cout << std::hex << (unsigned)buf[i] << " ";
-        std::cout << std::endl;
-    }
+    size_t writes() const { return s->writes; }
+
+    void fail_after(size_t n) { s->accept = n; }
 };
 
 int main()
 {
-    connection p = test_socket();
+    test_socket sock;
+    connection p(sock);
 
-    sequence<int, int, char, uint64_t> seq(1, 2, 0x22, 8);
+    std::tuple<int, int, char, uint64_t> seq(1, 2, 0x22, 8);
 
     p.write(seq);
+    assert(sock.writes() == 1);
 
-    sequence<uint64_t, uint64_t, uint8_t> q;
+    // same bytes, other layout: little endian
+    std::tuple<uint64_t, uint64_t, uint8_t> q;
 
     p.read(q);
 
-    std::cout << get<0>(q) << " " << get<1>(q) << " " << (uint32_t)get<2>(q) << std::endl;
+    assert(std::get<0>(q) == (uint64_t(2) << 32 | 1));
+    assert(std::get<1>(q) == (uint64_t(8) << 8 | 0x22));
+    assert(std::get<2>(q) == 0);
+
+    // messages of batch go in one send
+    {
+        write_batch b(p);
+        for(uint16_t i = 0; i < 10; i++)
+            p.write(i);
+        assert(sock.writes() == 1);
+    }
+    assert(sock.writes() == 2);
+
+    binary_istream is = p.read_stream(10 * sizeof(uint16_t));
+    for(uint16_t i = 0; i < 10; i++) {
+        uint16_t v;
+        is >> v;
+        assert(v == i);
+    }
+
+    // single pass serialization
+    p.write_stream([](binary_ostream& os) { os << uint32_t(0xA5A5A5A5); });
+
+    uint32_t v = 0;
+    p.read(v);
+    assert(v == 0xA5A5A5A5);
+
+    // short write: error is thrown, stream is not used again
+    {
+        test_socket fail;
+        connection c(fail);
+        fail.fail_after(6);
+
+        bool thrown = false;
+        try {
+            c.write(uint64_t(1));
+        }
+        catch(const std::runtime_error&) {
+            thrown = true;
+        }
+        assert(thrown && c.is_broken());
+
+        // broken connection: later writes are dropped
+        size_t writes = fail.writes();
+        thrown = false;
+        try {
+            c.write(uint8_t(2));
+        }
+        catch(const std::runtime_error&) {
+            thrown = true;
+        }
+        assert(thrown && fail.writes() == writes);
+    }
+
+    {
+        test_socket fail;
+        connection c(fail);
+        fail.fail_after(0);
+
+        {
+            write_batch b(c);
+            c.write(uint32_t(1));
+        }
+        assert(c.is_broken()); // failure of batch end is thrown by next write
+    }
 
     return 0;
 }
@@ -9,26 +9,25 @@ using namespace robot;
 
 struct char_key;
 struct long_key;
-struct sub_sequence_key;
 struct sub_tuple_key;
 
 using tuple_0_t = std::tuple<int, pair<char_key, char>,  pair<sub_tuple_key, std::tuple<short, pair<long_key, long>>>, int*>;
-using sequence_0_t = sequence<int, pair<char_key, char>,  pair<sub_sequence_key, sequence<short, pair<long_key, long>>>, int*>;
 
 struct key0;
 struct key1;
 struct key2;
 
+// constants are serialized, checked on read
 template <typename T0, typename T1>
-using sequence_1_t =
-sequence
+using tuple_1_t =
+std::tuple
 <
     std::integral_constant<T0, 55>,
     std::integral_constant<T1, 44>,
-    sequence
+    std::tuple
     <
     >,
-    sequence
+    std::tuple
     <
         pair<key0, int>,
         pair<key1, char>,
@@ -36,17 +35,7 @@ sequence
     >
 >;
 
-using sequence_10_t = sequence_1_t<char, short>;
-
-using is_compile_time_constant_check =
-sequence
-<
-    pair<int, std::integral_constant<int, 55>>,
-    std::integral_constant<short, 44>,
-    sequence
-    <
-    >
->;
+using tuple_10_t = tuple_1_t<char, short>;
 
 int main()
 {
@@ -71,73 +60,70 @@ int main()
 
     ///////////////////////////////////////////////////////
     //
-    //                  sequence test
+    //              keys and constants test
     //
     ///////////////////////////////////////////////////////
 
     {
 
-    static_assert(std::is_same<value_type_at_c<0, sequence_0_t>, int>::value, "0");
-    static_assert(std::is_same<value_type_at_c<1, sequence_0_t>, char>::value, "1");
-    static_assert(std::is_same<value_type_at_c<2, sequence_0_t>, sequence<short, pair<long_key, long>>>::value, "2");
-    static_assert(std::is_same<value_type_at_c<3, sequence_0_t>, int*>::value, "3");
-
-    sequence_0_t sequence_0;
-    const sequence_0_t& sequence_0_o = sequence_0;
-
-    get<0>(sequence_0_t());
-    get<0>(sequence_0_o);
-
-    get<0>(sequence_0) = 3;
+    static_assert(std::is_same<std::tuple_element<0, tuple_0_t>::type, int>::value, "0");
+    static_assert(std::is_same<std::tuple_element<1, tuple_0_t>::type, pair<char_key, char>>::value, "1");
+    static_assert(std::is_same<at_key<sub_tuple_key, tuple_0_t>, std::tuple<short, pair<long_key, long>>>::value, "2");
+    static_assert(std::is_same<std::tuple_element<3, tuple_0_t>::type, int*>::value, "3");
 
-    get<long_key>(get<2>(sequence_0)) = 71;
+    tuple_0_t tuple_00;
+    const tuple_0_t& tuple_00_o = tuple_00;
 
-    static_assert(std::is_same<decltype (robot::sequence_element<unsigned char>::value), uint8_t >::value, "0");
+    std::get<0>(tuple_00) = 3;
+    get<char_key>(tuple_00) = 5;
+    get<long_key>(get<sub_tuple_key>(tuple_00)) = 71;
 
-    assert(get<1>(get<sub_sequence_key>(sequence_0)) == 71);
-    assert(get<1>(get<sub_sequence_key>(sequence_0)) == get<long_key>(get<2>(sequence_0)));
-    assert(&get<1>(get<sub_sequence_key>(sequence_0)) == &get<long_key>(get<2>(sequence_0)));
+    assert(std::get<0>(tuple_00_o) == 3);
+    assert(get<char_key>(tuple_00_o) == 5);
+    assert(get<long_key>(get<sub_tuple_key>(tuple_00_o)) == 71);
+    assert(&get<long_key>(get<sub_tuple_key>(tuple_00_o)) == &std::get<1>(get<sub_tuple_key>(tuple_00)).value);
 
-    sequence_0_t sequence_01(1, 2, sequence<short, pair<long_key, long>>(9, 431), (int*)(0));
+    tuple_10_t tuple_10;
+    get<key0>(std::get<3>(tuple_10)) = 3;
+    get<key1>(std::get<3>(tuple_10)) = 4;
 
-    assert(get<0>(sequence_01) == 1);
-    assert(get<1>(sequence_01) == 2);
-
-    assert(get<1>(get<sub_sequence_key>(sequence_01)) == 431);
-    assert(get<1>(get<sub_sequence_key>(sequence_01)) == get<long_key>(get<2>(sequence_01)));
-    assert(&get<1>(get<sub_sequence_key>(sequence_01)) == &get<long_key>(get<2>(sequence_01)));
-
-    sequence_10_t
-    sequence_10 = sequence_10_t
-    (
-        sequence<int, int, std::integral_constant<int, 99>>(3, 4)
-    );
-
-    auto p = get<key1>(get<3>(sequence_10));
+    auto p = get<key1>(std::get<3>(tuple_10));
     static_assert(std::is_same<decltype(p), char>::value, "additional check");
 
-    static_assert(is_constexpr<std::integral_constant<char, 55>>::value, "is_compile_time_constant error 0");
-    static_assert(is_constexpr<is_compile_time_constant_check>::value, "is_compile_time_constant error 1");
+    static_assert(is_constant_size<std::integral_constant<char, 55>>::value, "is_constant_size error 0");
+    static_assert(is_constant_size<tuple_10_t>::value, "is_constant_size error 1");
+    static_assert(!is_constant_size<std::tuple<int, repeat<uint8_t, int>>>::value, "is_constant_size error 2");
+    static_assert(static_size<tuple_10_t>::value == 1 + 2 + 4 + 1 + 4, "static_size error 0");
 
-    sequence_10_t
-    sequence_101 = sequence_10_t
-    (
-        sequence<int, int, std::integral_constant<int, 99>>()
-    );
+    assert(std::get<1>(tuple_10).value == 44);
+    assert(get<key2>(std::get<3>(tuple_10)).value == 99);
 
-    assert(get<1>(sequence_10) == 44);
-    assert(get<1>(sequence_101) == 44);
-    assert(get<2>(get<3>(sequence_101)) == 99);
+    size_calc_stream s;
+    s << tuple_10;
+    assert(s.get() == 1 + 2 + 4 + 1 + 4);
 
-    static_assert(std::is_same<value_type_at_c<0, sequence_10_t>, const char>::value, "0");
+    binary_buffer buf(s.get());
+    binary_ostream os(buf);
+    os << tuple_10;
 
-    int r0 = 0;
-    char r1 = 1;
-    short r2 = 2;
+    tuple_10_t r;
+    binary_istream is(buf);
+    is >> r;
+    assert(get<key0>(std::get<3>(r)) == 3);
+    assert(get<key1>(std::get<3>(r)) == 4);
 
-    sequence<const int&, const char&, const short&> tie(r0, r1, r2);
+    // other constant value
+    buf.data[1] = 45;
 
-    get<0>(tie);
+    binary_istream is_bad(buf);
+    bool thrown = false;
+    try {
+        is_bad >> r;
+    }
+    catch(const constant_mismatch_error&) {
+        thrown = true;
+    }
+    assert(thrown);
 
     }
 
@@ -208,30 +194,36 @@ int main()
     assert(cvec[1] == 5);
     assert(cvec[2] == 8);
 
-    sequence
+    // count larger than data left: no allocation, stream error
+    {
+    char data[] = { (char)0xFF, 1, 2 };
+    binary_istream is_short(data, sizeof(data));
+    repeat<unsigned char, int> ivec;
+    bool thrown = false;
+    try {
+        is_short >> ivec;
+    }
+    catch(const std::out_of_range&) {
+        thrown = true;
+    }
+    assert(thrown);
+    assert(ivec.empty());
+    }
+
+    using inner_t =
+    std::tuple
     <
-        sequence
+        std::tuple
         <
-            sequence
-            <
-                std::integral_constant<int, 0x04030201>,
-                unsigned short
-            >,
-            repeat<unsigned char, char>
-        >
-    >
-    seq0
-    (
-        sequence
-        <
-            sequence
-            <
-                std::integral_constant<int, 0x04030201>,
-                unsigned short
-            >,
-            repeat<unsigned char, char>
-        >(0x0506, cvec)
-    );
+            std::integral_constant<int, 0x04030201>,
+            unsigned short
+        >,
+        repeat<unsigned char, char>
+    >;
+
+    std::tuple<inner_t> seq0;
+    std::get<1>(std::get<0>(std::get<0>(seq0))) = 0x0506;
+    std::get<1>(std::get<0>(seq0)) = cvec;
     
     size_calc_stream s_;
 
@@ -245,14 +237,14 @@ int main()
 
     os_ << seq0;
 
-    sequence<char, short, int> seq1;
+    std::tuple<char, short, int> seq1;
 
     is_ >> seq1;
 
     assert(s_.get() == 10);
-    assert(get<0>(seq1) == 0x1);
-    assert(get<1>(seq1) == 0x0302);
-    assert(get<2>(seq1) == 0x03050604);
+    assert(std::get<0>(seq1) == 0x1);
+    assert(std::get<1>(seq1) == 0x0302);
+    assert(std::get<2>(seq1) == 0x03050604);
 
         
     size_calc_stream s__;
@@ -265,16 +257,16 @@ int main()
     binary_ostream os__(buf__);
     binary_istream is__(buf__);
 
-    get<1>(get<0>(get<0>(seq0))) = 0x0708;
+    std::get<1>(std::get<0>(std::get<0>(seq0))) = 0x0708;
 
     os__ << seq0;
     any hz = make_storage_ref(seq1);
     is__ >> hz;
 
     assert(s__.get() == 10);
-    assert(get<0>(seq1) == 0x1);
-    assert(get<1>(seq1) == 0x0302);
-    assert(get<2>(seq1) == 0x03070804);
+    assert(std::get<0>(seq1) == 0x1);
+    assert(std::get<1>(seq1) == 0x0302);
+    assert(std::get<2>(seq1) == 0x03070804);
     }
 
     ///////////////////////////////////////////////////////
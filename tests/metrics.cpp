@@ -0,0 +1,199 @@
+#include <cassert>
+#include <atomic>
+#include <thread>
+#include <sstream>
+
+#include "device.h"
+#include "multi_server.h"
+
+using namespace robot;
+
+uint64_t message_count(const metrics::snapshot& s, uint16_t group, uint16_t type)
+{
+    for(auto& m : s.messages)
+        if(std::get<0>(m) == group && std::get<1>(m) == type)
+            return std::get<2>(m);
+    return 0;
+}
+
+int main()
+{
+    // buckets: bound is not below value, relative error < 1/16
+    {
+        using metrics::histogram;
+
+        size_t prev = 0;
+        for(uint64_t v = 0; v < 100000; v++) {
+            size_t i = histogram::index(v);
+            assert(i >= prev && i < histogram::BUCKETS);
+            assert(histogram::upper_bound(i) >= v);
+            assert(histogram::upper_bound(i) - v <= v / 16);
+            prev = i;
+        }
+
+        uint64_t big = ~uint64_t(0);
+        assert(histogram::index(big) == histogram::BUCKETS - 1);
+        assert(histogram::upper_bound(histogram::BUCKETS - 1) == big);
+    }
+
+    // percentiles and max
+    {
+        for(uint64_t v = 1; v <= 1000; v++)
+            metrics::record(metrics::SIP_INTERVAL, v);
+
+        metrics::summary s = metrics::collect().hist[metrics::SIP_INTERVAL];
+        assert(s.count == 1000);
+        assert(s.max == 1000);
+        assert(s.p50 >= 500 && s.p50 <= 500 + 500 / 16);
+        assert(s.p99 >= 990 && s.p99 <= 1000);
+    }
+
+    // shards of all threads, also finished ones
+    {
+        metrics::snapshot before = metrics::collect();
+
+        std::vector<std::thread> threads;
+        for(size_t t = 0; t < 4; t++)
+            threads.emplace_back
+            (
+                []()
+                {
+                    for(size_t i = 0; i < 1000; i++) {
+                        metrics::message(3, 15);
+                        metrics::bytes_in(2);
+                    }
+                }
+            );
+        for(auto& t : threads)
+            t.join();
+
+        metrics::snapshot after = metrics::collect();
+        assert(message_count(after, 3, 15) - message_count(before, 3, 15) == 4000);
+        assert(after.bytes_in - before.bytes_in == 8000);
+
+        // unknown types in last cell
+        metrics::message(100, 2);
+        assert(message_count(metrics::collect(), 3, 15) == message_count(after, 3, 15) + 1);
+    }
+
+    // switched off
+    {
+        metrics::set_enabled(false);
+
+        metrics::snapshot before = metrics::collect();
+        metrics::bytes_out(10);
+        {
+            metrics::scope_timer t(metrics::ENCODE);
+        }
+        metrics::snapshot after = metrics::collect();
+
+        assert(after.bytes_out == before.bytes_out);
+        assert(after.hist[metrics::ENCODE].count == before.hist[metrics::ENCODE].count);
+
+        metrics::set_enabled(true);
+    }
+
+    // sampled timers
+    {
+        metrics::snapshot before = metrics::collect();
+        for(size_t i = 0; i < 256; i++)
+            metrics::scope_timer t(metrics::ENCODE);
+        metrics::snapshot after = metrics::collect();
+        assert(after.hist[metrics::ENCODE].count - before.hist[metrics::ENCODE].count == 4);
+
+        bool thrown = false;
+        try {
+            metrics::set_sample_period(3);
+        }
+        catch(const std::invalid_argument&) {
+            thrown = true;
+        }
+        assert(thrown);
+
+        // every call below
+        metrics::set_sample_period(1);
+    }
+
+    // reg actions, intervals
+    {
+        reg<second<uint32_t>, READ_FLAG> r;
+        size_t calls = 0;
+        r.add_action([&calls]() { ++calls; });
+
+        uint64_t before = metrics::collect().hist[metrics::REG_ACTION].count;
+        r.set(second<uint32_t>(1));
+        r.set(second<uint32_t>(2));
+        assert(calls == 2);
+        assert(metrics::collect().hist[metrics::REG_ACTION].count == before + 2);
+
+        metrics::interval_meter m(metrics::SIP_INTERVAL);
+        before = metrics::collect().hist[metrics::SIP_INTERVAL].count;
+        m.tick();
+        m.tick();
+        m.reset();
+        m.tick();
+        m.tick();
+        assert(metrics::collect().hist[metrics::SIP_INTERVAL].count == before + 2);
+    }
+
+    // snapshot over protocol
+    {
+        using namespace common_protocol;
+
+        multi_server srv(INADDR_LOOPBACK, 5212);
+
+        reg<second<uint32_t>, READ_FLAG> r;
+        auto& f = srv.get_function_ref(1, 0);
+        f = move_control_function();
+        f[0xE] = r.make_parameter(0xE);
+
+        std::atomic<bool> done(false);
+        std::thread loop([&]() { while(!done) srv.run_once(10); });
+
+        client c(tcp_client(INADDR_LOOPBACK, 5212));
+        c.update_config();
+
+        for(size_t i = 0; i < 3; i++) {
+            std::stringstream req("1 0 1 14 0");
+            c.read_parameter_values(req);
+            c.client_package_parse();
+        }
+
+        c.request_metrics();
+        c.client_package_parse();
+
+        done = true;
+        loop.join();
+
+        const metrics_info& m = c.get_metrics();
+        assert(get<bytes_in_key>(m) > 0);
+        assert(get<bytes_out_key>(m) > 0);
+
+        // requests of this test, counted before reply
+        bool reads = false, metrics_requests = false;
+        for(auto& t : get<message_counts_key>(m)) {
+            if(std::get<0>(t) == 2 && std::get<1>(t) == 0)
+                reads = std::get<2>(t) >= 3;
+            if(std::get<0>(t) == 0 && std::get<1>(t) == metrics_request_key::value)
+                metrics_requests = std::get<2>(t) >= 1;
+        }
+        assert(reads && metrics_requests);
+
+        auto& hist = get<histograms_key>(m);
+        assert(hist.size() == metrics::HISTOGRAMS);
+        assert(get<count_key>(hist[metrics::DECODE]) >= 3);
+        assert(get<count_key>(hist[metrics::DISPATCH]) >= 3);
+        assert(get<count_key>(hist[metrics::ENCODE]) >= 3);
+        assert(get<p50_key>(hist[metrics::DISPATCH]) <= get<max_key>(hist[metrics::DISPATCH]));
+    }
+
+    // text dump
+    {
+        std::stringstream os;
+        metrics::dump(os);
+        assert(os.str().find("bytes in") != std::string::npos);
+        assert(os.str().find("sip interval, us") != std::string::npos);
+    }
+
+    return 0;
+}
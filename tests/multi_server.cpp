@@ -0,0 +1,270 @@
+#include <cassert>
+#include <atomic>
+#include <thread>
+#include <sstream>
+
+#include "device.h"
+#include "multi_server.h"
+
+using namespace robot;
+
+int main()
+{
+    multi_server srv(INADDR_LOOPBACK, 5201);
+
+    reg<second<uint32_t>, READ_FLAG | WRITE_FLAG> r;
+
+    auto& f = srv.get_function_ref(1, 0);
+    f = move_control_function();
+    f[0xE] = r.make_parameter(0xE);
+
+    r.set(second<uint32_t>(77));
+
+    std::atomic<bool> done(false);
+    std::thread loop([&]() { while(!done) srv.run_once(10); });
+
+    // half of header, must not stall other clients
+    tcp_socket stalled = tcp_client(INADDR_LOOPBACK, 5201);
+    const char partial[] = { (char)0xD7, (char)0xA5, 0, 0 };
+    stalled.write(partial, sizeof(partial));
+
+    for(size_t i = 0; i < 3; i++) {
+        client c(tcp_client(INADDR_LOOPBACK, 5201));
+        c.update_config();
+
+        std::stringstream req("1 0 1 14 0");
+        c.read_parameter_values(req);
+        c.client_package_parse();
+
+        std::stringstream res;
+        auto reader = c.parameter_ref(1, 0, 0xE)->get_value_reader();
+        std::get<0>(reader).write(res);
+        assert(res.str() == "77");
+    }
+
+    // service group
+    {
+        using namespace common_protocol;
+
+        connection c(tcp_client(INADDR_LOOPBACK, 5201));
+
+        c.write
+        (
+            make_message
+            <
+                service_group_key,
+                active_connections_request_key
+            >(active_connections_request())
+        );
+
+        message<service_group_key, active_connections_info_key> m;
+        c.read(m);
+
+        auto& info = get<body_key>(m);
+        assert(get<num_of_control_slots_key>(info) == 1);
+        assert(get<num_of_monitor_slots_key>(info) == 8);
+        assert(get<num_of_free_control_slots_key>(info) == 1);
+
+        c.write
+        (
+            make_message
+            <
+                service_group_key,
+                control_level_activation_request_key
+            >(control_level_activation_request(), 7)
+        );
+
+        message<service_group_key, command_return_code_key> ret;
+        c.read(ret);
+
+        assert(get<command_num_key>(get<body_key>(ret)) == 7);
+        assert(get<return_code_key>(get<body_key>(ret)) == CMD_DONE);
+
+        // type of other side: answered by same handler, session stays
+        c.write
+        (
+            make_message
+            <
+                service_group_key,
+                disconnect_code_key
+            >(DISCONNECT_BY_REQUEST, 9)
+        );
+
+        c.read(ret);
+        assert(get<command_num_key>(get<body_key>(ret)) == 9);
+        assert(get<return_code_key>(get<body_key>(ret)) == CMD_NOT_SUPPORTED);
+
+        c.write
+        (
+            make_message
+            <
+                service_group_key,
+                active_connections_request_key
+            >(active_connections_request())
+        );
+
+        c.read(m);
+        assert(get<num_of_free_control_slots_key>(get<body_key>(m)) == 0);
+    }
+
+    // unknown ids are answered, session stays
+    {
+        using namespace common_protocol;
+
+        connection c(tcp_client(INADDR_LOOPBACK, 5201));
+
+        // unknown function, then unknown parameter of known one
+        for(auto id : { function_id_t(5, 3), function_id_t(1, 0) }) {
+            function_value_read_request req;
+            std::get<0>(req) = id;
+            std::get<1>(req).push_back(std::tuple<uint8_t, uint8_t>(0x0, 0));
+
+            c.write(make_message<data_access_group_key, function_value_read_request_key>(req, 4));
+
+            message_header header;
+            c.read(header);
+            assert(get<type_key>(header) == function_value_read_denied_key::value);
+            assert(get<message_num_key>(header) == 4);
+
+            function_value_read_denied denied;
+            c.read(get<data_size_key>(header), denied);
+            assert(denied.size() == 1 && std::get<0>(denied[0]) == 0);
+        }
+
+        // write to unknown function: f_code, f_number, count, p_code, value
+        std::tuple<uint16_t, uint16_t, uint8_t, uint8_t, uint32_t> body(5, 0, 1, 0xE, 1);
+
+        message_header header;
+        get<group_key      >(header) = data_access_group_key::value;
+        get<type_key       >(header) = function_value_write_key::value;
+        get<message_num_key>(header) = 11;
+        get<data_size_key  >(header) = calc_size(body);
+        c.write(header);
+        c.write(body);
+
+        message<service_group_key, command_return_code_key> ret;
+        c.read(ret);
+        assert(get<command_num_key>(get<body_key>(ret)) == 11);
+        assert(get<return_code_key>(get<body_key>(ret)) == CMD_BAD_FORMAT);
+
+        // valid and unknown parameter in one write: none is changed
+        std::tuple<uint16_t, uint16_t, uint8_t, uint8_t, uint32_t, uint8_t, uint32_t>
+        mixed(1, 0, 2, 0xE, 5, 0x0, 1);
+
+        get<message_num_key>(header) = 14;
+        get<data_size_key  >(header) = calc_size(mixed);
+        c.write(header);
+        c.write(mixed);
+
+        c.read(ret);
+        assert(get<command_num_key>(get<body_key>(ret)) == 14);
+        assert(get<return_code_key>(get<body_key>(ret)) == CMD_BAD_FORMAT);
+        {
+            client cl(tcp_client(INADDR_LOOPBACK, 5201));
+            cl.update_config();
+
+            std::stringstream req("1 0 1 14 0");
+            cl.read_parameter_values(req);
+            cl.client_package_parse();
+
+            std::stringstream res;
+            std::get<0>(cl.parameter_ref(1, 0, 0xE)->get_value_reader()).write(res);
+            assert(res.str() == "77");
+        }
+
+        c.write(make_message<config_group_key, function_config_request_key>(function_id_t(5, 0), 12));
+        c.read(ret);
+        assert(get<command_num_key>(get<body_key>(ret)) == 12);
+        assert(get<return_code_key>(get<body_key>(ret)) == CMD_BAD_FORMAT);
+
+        // known parameter is still served
+        function_value_read_request req;
+        std::get<0>(req) = function_id_t(1, 0);
+        std::get<1>(req).push_back(std::tuple<uint8_t, uint8_t>(0xE, 0));
+        std::get<1>(req).push_back(std::tuple<uint8_t, uint8_t>(0x0, 0));
+        c.write(make_message<data_access_group_key, function_value_read_request_key>(req, 13));
+
+        c.read(header);
+        assert(get<type_key>(header) == function_value_read_denied_key::value);
+        function_value_read_denied denied;
+        c.read(get<data_size_key>(header), denied);
+        assert(denied.size() == 1);
+
+        c.read(header);
+        assert(get<type_key>(header) == function_value_read_key::value);
+    }
+
+    // periodical delivery
+    {
+        using namespace common_protocol;
+
+        tcp_socket sock = tcp_client(INADDR_LOOPBACK, 5201);
+        client c(sock);
+        connection raw(sock);
+
+        c.update_config();
+
+        function_value_read_periodical_request req;
+        std::get<0>(req) = function_id_t(1, 0);
+        std::get<1>(req).push_back(std::tuple<uint8_t, uint8_t>(0xE, 0));
+        std::get<1>(req).push_back(std::tuple<uint8_t, uint8_t>(0x0, 0));
+        std::get<2>(req) = 5000; // us
+
+        raw.write
+        (
+            make_message
+            <
+                data_access_group_key,
+                function_value_read_periodical_request_key
+            >(req)
+        );
+
+        // parameter 0 is not supported, denied
+        message_header header;
+        raw.read(header);
+        assert(get<type_key>(header) == function_value_read_denied_key::value);
+        function_value_read_denied denied;
+        raw.read(get<data_size_key>(header), denied);
+        assert(denied.size() == 1 && std::get<0>(denied[0]) == 0);
+
+        for(uint32_t v = 100; v < 103; v++) {
+            r.set(second<uint32_t>(v)); // races with tick, only last value checked
+            c.client_package_parse();
+        }
+
+        c.client_package_parse();
+        c.client_package_parse();
+
+        std::stringstream res;
+        auto reader = c.parameter_ref(1, 0, 0xE)->get_value_reader();
+        std::get<0>(reader).write(res);
+        assert(res.str() == "102");
+    }
+
+    // pipelined requests before half-close are answered
+    {
+        using namespace common_protocol;
+
+        tcp_socket sock = tcp_client(INADDR_LOOPBACK, 5201);
+        connection c(sock);
+
+        for(uint32_t i = 0; i < 3; i++)
+            c.write(make_message<config_group_key, function_config_request_key>(function_id_t(5, 0), 20 + i));
+        c.flush();
+
+        shutdown(sock.handle(), SHUT_WR);
+
+        message<service_group_key, command_return_code_key> ret;
+        for(uint32_t i = 0; i < 3; i++) {
+            c.read(ret);
+            assert(get<command_num_key>(get<body_key>(ret)) == 20 + i);
+        }
+    }
+
+    stalled.close();
+
+    done = true;
+    loop.join();
+
+    return 0;
+}
@@ -0,0 +1,77 @@
+#include <cassert>
+#include <cstdlib>
+#include <vector>
+
+#include "../device/pioneer_2at.h"
+
+using namespace robot;
+using namespace robot::p2at;
+
+// byte pair reference
+uint16_t reference(const char *ptr, uint16_t n)
+{
+    uint16_t c = 0;
+    const uint8_t *p =  (const uint8_t*)ptr;
+
+    while (n > 1) {
+        c += (*(p)<<8) | *(p+1);
+        n -= 2;
+        p += 2;
+    }
+
+    if (n > 0)
+        c ^= (uint16_t)*(p++);
+    return ((c % 0x100) << 8) | (c / 0x100);
+}
+
+template <typename Msg>
+std::vector<char> serialized(const Msg& m)
+{
+    binary_buffer b = make_buffer(m);
+    return std::vector<char>(b.data, b.data + b.size);
+}
+
+template <uint8_t CmdNum, typename T>
+std::vector<char> written(const T& p)
+{
+    std::vector<char> out(5, 'x');
+    binary_ostream os(out, 5);
+    write_p2_at_cmd<CmdNum>(os, p);
+    out.resize(5 + os.pos());
+    return std::vector<char>(out.begin() + 5, out.end());
+}
+
+int main()
+{
+    srand(1);
+
+    // random lengths, contents and alignments
+    std::vector<char> buf(70000 + 8);
+
+    for(size_t i = 0; i < 20000; i++) {
+        size_t n = i < 300 ? i : rand() % 1024;
+        if(i % 1000 == 999)
+            n = 65535 - rand() % 16;
+
+        size_t offset = rand() % 8;
+        uint8_t fill = rand() % 4 == 0 ? 0xFF : 0; // saturated lanes
+
+        for(size_t j = 0; j < n; j++)
+            buf[offset + j] = fill ? fill : char(rand());
+
+        assert(chck_sum_calc(buf.data() + offset, n) == reference(buf.data() + offset, n));
+    }
+
+    // one pass commands: same bytes as message tuples
+    assert((written<11>(int16_t(-300)) == serialized(make_p2_at_cmd<11>(int16_t(-300)))));
+    assert((written<21>(int16_t(45)) == serialized(make_p2_at_cmd<21>(int16_t(45)))));
+    assert((written<4>(uint16_t(1)) == serialized(make_p2_at_cmd<4>(uint16_t(1)))));
+    assert((written<0>(std::tuple<>()) == serialized(make_p2_at_cmd<0>())));
+
+    // SYNC0: FA FB 03 00 00 00
+    std::vector<char> sync0 = written<0>(std::tuple<>());
+    const char ref[] = { (char)0xFA, (char)0xFB, 3, 0, 0, 0 };
+    assert(sync0 == std::vector<char>(ref, ref + sizeof(ref)));
+
+    return 0;
+}
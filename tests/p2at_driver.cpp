@@ -0,0 +1,210 @@
+#include <cassert>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include <sys/socket.h>
+
+#include "../device/p2at_driver.h"
+#include "../device/p2at_sim.h"
+#include "p2at_util.h"
+
+using namespace robot;
+using namespace robot::p2at;
+
+// robot side of link: blocking socket
+
+std::string receive(int fd)
+{
+    std::string res;
+    char buf[1024];
+
+    int n;
+    while((n = recv(fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0)
+        res.append(buf, n);
+
+    return res;
+}
+
+void send_str(int fd, const std::string& s)
+{
+    assert(send(fd, s.data(), s.size(), 0) == int(s.size()));
+}
+
+template <uint8_t CmdNum, typename T = std::tuple<>>
+std::string cmd(const T& arg = T())
+{
+    return p2_at_cmd_packet<CmdNum>(arg);
+}
+
+std::string make_sip(uint16_t x)
+{
+    sip data;
+    get<status_key>(data) = 0x32;
+    get<x_pos_key>(data) = x;
+    get<sonar_measurements>(data).resize(8);
+    return p2_at_packet(data);
+}
+
+int main()
+{
+    int fds[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    int robot_fd = fds[1];
+
+    reactor loop;
+
+    std::vector<int16_t> x;
+    auto on_sip = [&](const sip_view& v) { x.push_back(v.x_pos().get_value()); };
+
+    // reply, sip, pulse, tick
+    link_timeouts t(100000, 300000, 30000, 5000);
+
+    driver d(loop, tcp_socket(fds[0]), on_sip, t);
+
+    // handshake
+    {
+        assert(d.get_state() == driver::SYNC0);
+        assert(receive(robot_fd) == cmd<0>());
+
+        send_str(robot_fd, cmd<0>()); // echo
+        loop.run_once(10);
+        assert(d.get_state() == driver::SYNC1);
+        assert(receive(robot_fd) == cmd<1>());
+
+        send_str(robot_fd, cmd<1>());
+        loop.run_once(10);
+        assert(d.get_state() == driver::SYNC2);
+        assert(receive(robot_fd) == cmd<2>());
+
+        send_str(robot_fd, p2_at_packet("\x02" "P2AT\0Pioneer\0", 14));
+        loop.run_once(10);
+        assert(d.get_state() == driver::RUNNING);
+
+        // OPEN and ENABLE in one write
+        assert(receive(robot_fd) == cmd<1>() + cmd<4>(uint16_t(1)));
+    }
+
+    // commands from any thread
+    {
+        d.command<11>(int16_t(300));
+        d.command<21>(int16_t(-10));
+        loop.run_once(10);
+        assert(receive(robot_fd) == cmd<11>(int16_t(300)) + cmd<21>(int16_t(-10)));
+    }
+
+    // garbage and corrupted packet cost one packet
+    {
+        std::string bad = make_sip(2);
+        bad[8] ^= 0x10;
+
+        send_str(robot_fd, "\x01\xFA" "abc" + make_sip(1) + bad + "\xFA" + make_sip(3));
+        loop.run_once(10);
+
+        assert(x.size() == 2 && x[0] == 1 && x[1] == 3);
+        assert(d.get_counters().bad >= 1);
+        assert(d.get_counters().skipped >= 6);
+
+        // packet split between reads
+        std::string s = make_sip(4);
+        send_str(robot_fd, s.substr(0, 10));
+        loop.run_once(10);
+        assert(x.size() == 2);
+        send_str(robot_fd, s.substr(10));
+        loop.run_once(10);
+        assert(x.size() == 3 && x[2] == 4);
+    }
+
+    // PULSE keepalive
+    {
+        receive(robot_fd);
+        run_for(loop, 100);
+        std::string out = receive(robot_fd);
+        assert(out.size() >= cmd<0>().size() * 2);
+        assert(out.substr(0, cmd<0>().size()) == cmd<0>());
+        assert(d.get_state() == driver::RUNNING);
+        assert(d.get_counters().restarts == 0);
+    }
+
+    // SIP silence: link closed, handshake restarted
+    {
+        auto end = test_clock::now() + std::chrono::milliseconds(1000);
+        while(d.get_state() == driver::RUNNING && test_clock::now() < end)
+            loop.run_once(1);
+
+        assert(d.get_state() == driver::SYNC0);
+        assert(d.get_counters().restarts == 1);
+
+        std::string out = receive(robot_fd);
+        std::string restart = cmd<2>() + cmd<0>();
+        assert(out.find(restart) != std::string::npos);
+
+        // no echo: SYNC0 is repeated
+        run_for(loop, 150);
+        assert(d.get_counters().restarts >= 2);
+        assert(receive(robot_fd).find(cmd<0>()) != std::string::npos);
+
+        send_str(robot_fd, cmd<0>());
+        loop.run_once(10);
+        assert(d.get_state() == driver::SYNC1);
+    }
+
+    // robot disconnect
+    {
+        close(robot_fd);
+        loop.run_once(10);
+        assert(d.is_closed());
+    }
+
+    // robot address: connect is retried, lost link is connected again
+    {
+        enum { PORT = 8311 };
+
+        size_t sips = 0;
+        driver r
+        (
+            loop,
+            INADDR_LOOPBACK,
+            PORT,
+            [&sips](const sip_view&) { ++sips; },
+            link_timeouts(100000, 300000, 30000, 5000, 20000, 80000)
+        );
+
+        // robot is not started yet
+        run_for(loop, 200);
+        assert(!r.is_closed());
+        assert(r.get_state() == driver::SYNC0);
+        assert(r.get_counters().reconnects >= 2);
+
+        std::unique_ptr<simulator> robot(new simulator(loop, INADDR_LOOPBACK, PORT, sim_config(8, 200)));
+        assert(run_until(loop, [&r, &sips]() { return r.get_state() == driver::RUNNING && sips > 0; }));
+
+        // robot restart
+        robot.reset();
+        assert(run_until(loop, [&r]() { return r.get_state() != driver::RUNNING; }));
+        size_t reconnects = r.get_counters().reconnects;
+
+        run_for(loop, 100);
+        robot.reset(new simulator(loop, INADDR_LOOPBACK, PORT, sim_config(8, 200)));
+
+        size_t before = sips;
+        assert(run_until(loop, [&r, &sips, before]() { return r.get_state() == driver::RUNNING && sips > before; }));
+        assert(r.get_counters().reconnects > reconnects);
+        assert(!r.is_closed());
+
+        r.close();
+        assert(r.is_closed());
+    }
+
+    // driver destroyed with posted connect and command: closures are dropped
+    {
+        std::unique_ptr<driver> r(new driver(loop, INADDR_LOOPBACK, 8312, [](const sip_view&) {}, t));
+        r->command<11>(int16_t(100));
+        r.reset();
+
+        run_for(loop, 20);
+    }
+
+    return 0;
+}
@@ -0,0 +1,179 @@
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "../device/p2at_sim.h"
+#include "../device/p2at_gateway.h"
+
+using namespace robot;
+using namespace robot::p2at;
+
+using test_clock = std::chrono::steady_clock;
+
+enum { ROBOTS = 4, BASE_PORT = 8211 };
+
+// server thread
+std::string read_param(multi_server& srv, uint16_t f_code, uint16_t f_number, uint8_t p_code)
+{
+    std::stringstream s;
+    std::get<0>(srv.parameter_ref(f_code, f_number, p_code)->get_value_reader()).write(s);
+    return s.str();
+}
+
+void write_param
+(
+    multi_server& srv,
+    uint16_t f_code,
+    uint16_t f_number,
+    uint8_t p_code,
+    const std::string& v
+)
+{
+    auto& p = srv.parameter_ref(f_code, f_number, p_code);
+    auto w = p->get_value_writer();
+    std::stringstream s(v);
+    s >> w;
+    p->set_write();
+    p->on_write();
+}
+
+// robots on own thread, stopped to be changed or inspected
+class robots
+{
+    reactor loop;
+    std::vector<std::unique_ptr<simulator>> sims;
+
+    std::atomic<bool> done;
+    std::thread thread;
+public:
+    robots(): sims(ROBOTS), done(true) {}
+    ~robots() { stop(); }
+
+    void start()
+    {
+        done = false;
+        thread = std::thread([this]() { while(!done) loop.run_once(1); });
+    }
+
+    void stop()
+    {
+        if(done)
+            return;
+
+        done = true;
+        thread.join();
+    }
+
+    void add(size_t i)
+    {
+        sims[i].reset(new simulator(loop, INADDR_LOOPBACK, BASE_PORT + i, sim_config(16, 200)));
+    }
+
+    void remove(size_t i) { sims[i].reset(); }
+
+    simulator& operator[](size_t i) { return *sims[i]; }
+};
+
+int main()
+{
+    multi_server srv(INADDR_LOOPBACK, 5211);
+
+    std::vector<robot_address> addrs;
+    for(uint16_t i = 0; i < ROBOTS; i++)
+        addrs.push_back(robot_address{ INADDR_LOOPBACK, uint16_t(BASE_PORT + i) });
+
+    // reply, sip, pulse, tick, retry, max retry
+    gateway fleet(srv, addrs, 2, link_timeouts(1000000, 300000, 100000, 10000, 20000, 100000));
+    assert(fleet.robot_count() == ROBOTS);
+    assert(fleet.worker_count() == 2);
+
+    // main thread is server thread
+    auto serve_until =
+    [&](const std::function<bool()>& done)
+    {
+        auto end = test_clock::now() + std::chrono::seconds(3);
+        while(!done() && test_clock::now() < end)
+            srv.run_once(1);
+        return done();
+    };
+
+    auto serve_for =
+    [&](int ms)
+    {
+        auto end = test_clock::now() + std::chrono::milliseconds(ms);
+        while(test_clock::now() < end)
+            srv.run_once(1);
+    };
+
+    auto all_running =
+    [&]()
+    {
+        for(size_t i = 0; i < ROBOTS; i++)
+            if(fleet.get_link(i).get_state() != driver::RUNNING)
+                return false;
+        return true;
+    };
+
+    // robots are not started yet: connects are retried
+    fleet.start();
+    serve_for(100);
+    for(size_t i = 0; i < ROBOTS; i++) {
+        assert(!fleet.get_link(i).is_closed());
+        assert(fleet.get_link(i).get_state() == driver::SYNC0);
+    }
+
+    robots sims;
+    for(size_t i = 0; i < ROBOTS; i++)
+        sims.add(i);
+    sims.start();
+
+    assert(serve_until(all_running));
+
+    // every robot is a function number of one server,
+    // state is published on server thread
+    bool published =
+    serve_until
+    (
+        [&]()
+        {
+            for(size_t i = 0; i < ROBOTS; i++)
+                if(read_param(srv, 2, i, 0x0A).find("1500") == std::string::npos)
+                    return false;
+            return true;
+        }
+    );
+    assert(published);
+
+    for(size_t i = 0; i < ROBOTS; i++)
+        assert(read_param(srv, 1, i, 0x00) == "0");
+
+    // command goes to its robot only
+    write_param(srv, 1, 2, 0x0E, "250");
+    write_param(srv, 1, 2, 0x18, "1");
+
+    assert(serve_until([&]() { return read_param(srv, 1, 2, 0x00) != "0"; }));
+
+    sims.stop();
+    for(size_t i = 0; i < ROBOTS; i++) {
+        assert(sims[i].get_vel() == (i == 2 ? 250 : 0));
+        assert(sims[i].is_moving() == (i == 2));
+    }
+
+    // robot restart: link is connected again
+    sims.remove(1);
+    sims.start();
+    assert(serve_until([&]() { return fleet.get_link(1).get_state() != driver::RUNNING; }));
+
+    sims.stop();
+    sims.add(1);
+    sims.start();
+    assert(serve_until(all_running));
+
+    fleet.stop();
+    sims.stop();
+
+    return 0;
+}
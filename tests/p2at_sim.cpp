@@ -0,0 +1,117 @@
+#include <cassert>
+#include <memory>
+
+#include "../device/p2at_sim.h"
+#include "../device/p2at_driver.h"
+#include "p2at_util.h"
+
+using namespace robot;
+using namespace robot::p2at;
+
+enum { ROBOTS = 3, BASE_PORT = 8301 };
+
+struct link_state
+{
+    size_t sips = 0;
+    size_t sonars = 0;
+    int16_t x = 0;
+};
+
+int main()
+{
+    reactor loop;
+
+    // robots and driver links in one process, one loop
+    std::vector<std::unique_ptr<simulator>> sims;
+    std::vector<std::unique_ptr<driver>> links;
+    std::vector<link_state> seen(ROBOTS);
+
+    for(size_t i = 0; i < ROBOTS; i++) {
+        uint32_t rate = i == 0 ? 2000 : 200; // first one at kHz rate
+        sims.emplace_back
+        (
+            new simulator(loop, INADDR_LOOPBACK, BASE_PORT + i, sim_config(8, rate))
+        );
+
+        link_state& s = seen[i];
+        links.emplace_back
+        (
+            new driver
+            (
+                loop,
+                tcp_client(INADDR_LOOPBACK, BASE_PORT + i),
+                [&s](const sip_view& v)
+                {
+                    ++s.sips;
+                    s.sonars = v.sonar_count();
+                    s.x = v.x_pos().get_value();
+                }
+            )
+        );
+    }
+
+    // handshake
+    bool running =
+    run_until
+    (
+        loop,
+        [&]()
+        {
+            for(auto& l : links)
+                if(l->get_state() != driver::RUNNING)
+                    return false;
+            for(auto& s : seen)
+                if(s.sips == 0)
+                    return false;
+            return true;
+        }
+    );
+    assert(running);
+
+    for(auto& s : sims)
+        assert(s->get_state() == simulator::OPEN);
+
+    // SIP rate
+    for(auto& s : seen)
+        s.sips = 0;
+
+    run_for(loop, 300);
+
+    assert(seen[0].sips >= 300 && seen[0].sips <= 900);
+    for(size_t i = 1; i < ROBOTS; i++) {
+        assert(seen[i].sips >= 30 && seen[i].sips <= 90);
+        assert(seen[i].sonars == 8);
+        assert(seen[i].x == 0);
+    }
+
+    // velocity commands move robot
+    links[1]->command<11>(int16_t(500));
+    assert(run_until(loop, [&]() { return seen[1].x > 20; }));
+    assert(sims[1]->is_moving() && sims[1]->get_vel() == 500);
+    assert(!sims[2]->is_moving());
+
+    links[1]->command<11>(int16_t(0));
+    assert(run_until(loop, [&]() { return !sims[1]->is_moving(); }));
+
+    // client reconnects: handshake again
+    links[2].reset();
+    run_for(loop, 20);
+    assert(sims[2]->get_state() == simulator::SYNC0);
+
+    seen[2].sips = 0;
+    links[2].reset
+    (
+        new driver
+        (
+            loop,
+            tcp_client(INADDR_LOOPBACK, BASE_PORT + 2),
+            [&](const sip_view&) { ++seen[2].sips; }
+        )
+    );
+    assert(run_until(loop, [&]() { return seen[2].sips > 0; }));
+
+    for(auto& s : sims)
+        assert(s->get_counters().bad == 0);
+
+    return 0;
+}
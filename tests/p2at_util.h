@@ -0,0 +1,72 @@
+#ifndef __P2AT_UTIL__
+#define __P2AT_UTIL__
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "reactor.h"
+#include "../device/pioneer_2at.h"
+
+// helpers shared by P2AT tests
+
+namespace robot
+{
+namespace p2at
+{
+
+using test_clock = std::chrono::steady_clock;
+
+inline void run_for(reactor& loop, int ms)
+{
+    auto end = test_clock::now() + std::chrono::milliseconds(ms);
+    while(test_clock::now() < end)
+        loop.run_once(1);
+}
+
+inline bool run_until(reactor& loop, const std::function<bool()>& done, int ms = 2000)
+{
+    auto end = test_clock::now() + std::chrono::milliseconds(ms);
+    while(!done() && test_clock::now() < end)
+        loop.run_once(1);
+    return done();
+}
+
+// whole packets as strings: robot side of link
+
+template <typename T>
+inline std::string p2_at_packet(const T& data)
+{
+    std::vector<char> out;
+    binary_ostream os(out);
+    write_p2_at_msg(os, data);
+    return std::string(out.data(), os.pos());
+}
+
+// data bytes are framed as is
+inline std::string p2_at_packet(const char* data, size_t n)
+{
+    if(n + 2 > 0xFF)
+        throw std::out_of_range("error: p2at packet is too long");
+
+    std::string res = { char(0xFA), char(0xFB), char(n + 2) };
+    res.append(data, n);
+
+    uint16_t sum = chck_sum_calc(data, n);
+    res += char(sum & 0xFF);
+    res += char(sum >> 8);
+    return res;
+}
+
+template <uint8_t CmdNum, typename T = std::tuple<>>
+inline std::string p2_at_cmd_packet(const T& arg = T())
+{
+    p2_at_cmd<CmdNum, T> cmd;
+    get<cmd_arg>(cmd) = arg;
+    return p2_at_packet(cmd);
+}
+
+}}
+
+#endif //__P2AT_UTIL__
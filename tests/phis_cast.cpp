@@ -0,0 +1,117 @@
+#include <cassert>
+#include <stdexcept>
+
+#include "dimension.h"
+
+using namespace robot;
+
+using mm = dec_factor<-3, metre<int16_t>>;
+using cm = dec_factor<-2, metre<int32_t>>;
+using km = dec_factor< 3, metre<int32_t>>;
+using ms = dec_factor<-3, second<int32_t>>;
+
+template <typename F>
+bool throws(const F& f)
+{
+    try {
+        f();
+    }
+    catch(const std::out_of_range&) {
+        return true;
+    }
+    return false;
+}
+
+// conversion factors are compile time rationals
+static_assert(unit_factor<basic_units::metre, unit_type<mm>>::num == 1, "");
+static_assert(unit_factor<basic_units::metre, unit_type<mm>>::den == 1000, "");
+static_assert(unit_factor<unit_type<mm>, basic_units::metre>::num == 1000, "");
+
+// m / s => mm / ms, factors cancel
+using mps  = decltype(metre<int32_t>() / second<int32_t>());
+using mmps = decltype(dec_factor<-3, metre<int32_t>>() / ms());
+static_assert(unit_factor<unit_type<mmps>, unit_type<mps>>::num == 1, "");
+static_assert(unit_factor<unit_type<mmps>, unit_type<mps>>::den == 1, "");
+
+// area: exponent is scaled by power
+using m2 = decltype(metre<int32_t>() * metre<int32_t>());
+using cm2 = decltype(cm() * cm());
+static_assert(unit_factor<unit_type<cm2>, unit_type<m2>>::num == 10000, "");
+
+int main()
+{
+    // integers are exact
+    assert(phis_cast<mm>(metre<int16_t>(3)).get_value() == 3000);
+    assert(phis_cast<cm>(mm(1234)).get_value() == 123);
+    assert(phis_cast<cm>(mm(-1234)).get_value() == -123);
+    assert(phis_cast<cm2>(m2(3)).get_value() == 30000);
+    assert((phis_cast<dec_factor<-3, metre<uint16_t>>>(metre<uint8_t>(5)).get_value() == 5000));
+    assert((phis_cast<dec_factor<-2, metre<uint16_t>>, rounding::nearest>(dec_factor<-3, metre<uint16_t>>(15)).get_value() == 2));
+
+    // rounding
+    assert((phis_cast<cm, rounding::nearest>(mm(1235)).get_value() == 124));
+    assert((phis_cast<cm, rounding::nearest>(mm(1234)).get_value() == 123));
+    assert((phis_cast<cm, rounding::nearest>(mm(-1235)).get_value() == -124));
+    assert((phis_cast<cm, rounding::down>(mm(-1231)).get_value() == -124));
+    assert((phis_cast<cm, rounding::down>(mm(1239)).get_value() == 123));
+    assert((phis_cast<cm, rounding::up>(mm(1231)).get_value() == 124));
+    assert((phis_cast<cm, rounding::up>(mm(-1239)).get_value() == -123));
+
+    // floating point
+    assert(phis_cast<metre<double>>(mm(1500)).get_value() == 1.5);
+    assert((phis_cast<mm, rounding::nearest>(metre<double>(0.0126)).get_value() == 13));
+    assert(phis_cast<mm>(metre<double>(0.0126)).get_value() == 12);
+
+    // overflow
+    assert(!throws([]() { checked_phis_cast<mm>(metre<int32_t>(32)); }));
+    assert( throws([]() { checked_phis_cast<mm>(metre<int32_t>(33)); }));
+    assert( throws([]() { checked_phis_cast<mm>(metre<int32_t>(-33)); }));
+    assert( throws([]() { checked_phis_cast<mm>(metre<double>(40.0)); }));
+    assert(!throws([]() { checked_phis_cast<metre<int64_t>>(km(2000000000)); }));
+    assert( throws([]() { checked_phis_cast<dec_factor<-18, metre<int64_t>>>(metre<int64_t>(10)); }));
+
+    // comparison converts right operand to left operand unit
+    assert(phis_cast<km>(metre<int32_t>(2000)).get_value() == 2);
+    assert(mm(2000) == metre<int16_t>(2));
+
+    // ranges: same as element conversion
+    {
+        std::array<mm, 16> sonars;
+        for(size_t i = 0; i < sonars.size(); i++)
+            sonars[i] = mm(int16_t(i * 1237 - 9000));
+
+        auto m = phis_cast<metre<double>>(sonars);
+        auto c = phis_cast<cm, rounding::nearest>(sonars);
+
+        for(size_t i = 0; i < sonars.size(); i++) {
+            assert(m[i] == phis_cast<metre<double>>(sonars[i]));
+            assert(c[i].get_value() == (phis_cast<cm, rounding::nearest>(sonars[i]).get_value()));
+        }
+
+        using deg_per_second = decltype(degree<int16_t>() / second<int16_t>());
+        using deg_per_ms = decltype(degree<double>() / dec_factor<-3, second<double>>());
+
+        std::vector<deg_per_second> w(100, deg_per_second(45));
+        std::vector<deg_per_ms> r(w.size());
+        phis_cast(value_span<deg_per_second>(w.data(), w.size()), value_span<deg_per_ms>(r.data(), r.size()));
+        for(auto& v : r)
+            assert(v.get_value() == 0.045);
+
+        assert
+        (
+            throws
+            (
+                [&]()
+                {
+                    phis_cast(value_span<deg_per_second>(w.data(), 2), value_span<deg_per_ms>(r.data(), 3));
+                }
+            )
+        );
+
+        std::array<metre<int32_t>, 2> big = {{ metre<int32_t>(1), metre<int32_t>(40) }};
+        assert(throws([&]() { checked_phis_cast<mm>(big); }));
+        assert(phis_cast<mm>(big)[0].get_value() == 1000);
+    }
+
+    return 0;
+}
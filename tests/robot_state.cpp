@@ -0,0 +1,90 @@
+#include <cassert>
+
+#include "device.h"
+
+using namespace robot;
+using namespace robot::common_protocol;
+
+template <typename F>
+bool throws(const F& f)
+{
+    try {
+        f();
+    }
+    catch(const std::logic_error&) {
+        return true;
+    }
+    return false;
+}
+
+int main()
+{
+    robot_state state;
+
+    reg<second<uint32_t>, READ_FLAG | WRITE_FLAG> r;
+
+    auto& f = state.get_function_ref(1, 0);
+    f = move_control_function();
+    f[0xE] = r.make_parameter(0xE);
+    r.set(second<uint32_t>(5));
+
+    state.get_function_ref(2, 3);
+
+    // function addresses are stable
+    assert(&state.get_function_ref(1, 0) == &f);
+
+    auto list = state.get_f_list();
+    assert(list.size() == 2);
+    assert(std::get<0>(list[0]) == 1 && std::get<1>(list[0]) == 0);
+    assert(std::get<0>(list[1]) == 2 && std::get<1>(list[1]) == 3);
+
+    assert( state.is_readable(1, 0, 0xE));
+    assert(!state.is_readable(1, 0, 0xF0)); // no parameter
+    assert(!state.is_readable(1, 1, 0xE));  // no function
+    assert(!state.is_readable(7, 0, 0xE));
+
+    // unknown ids are rejected, not created
+    std::vector<uint8_t> codes{ 0xE };
+    assert(!throws([&]() { state.get_read_values(1, 0, codes); }));
+    assert( throws([&]() { state.get_read_values(1, 1, codes); }));
+    assert( throws([&]() { state.get_read_values(9, 0, codes); }));
+
+    codes.push_back(0xF0);
+    assert( throws([&]() { state.get_read_values(1, 0, codes); }));
+    assert(state.get_f_list().size() == 2);
+
+    // values of function parameters are contiguous in function arena
+    {
+        reg<second<uint32_t>, READ_FLAG> r0, r1;
+        reg<std::array<second<uint32_t>, 3>, READ_FLAG> r2;
+
+        auto& g = state.get_function_ref(2, 3);
+        g[0] = r0.make_parameter(0);
+        g[1] = r1.make_parameter(1);
+        g[2] = r2.make_parameter(2);
+
+        using p_t = parameter<READ_FLAG, uint32_t>;
+
+        auto v0 = static_cast<p_t*>(g.find(0))->val_ref().data();
+        auto v1 = static_cast<p_t*>(g.find(1))->val_ref().data();
+        auto& v2 = static_cast<p_t*>(g.find(2))->val_ref();
+
+        assert(v1 == v0 + 1 && v2.data() == v1 + 1 && v2.size() == 3);
+
+        std::array<second<uint32_t>, 3> a;
+        a[2] = second<uint32_t>(9);
+        r2.set(a);
+
+        // snapshot lands in arena when value is read
+        g.find(2)->get_value_reader();
+        assert(v2[2] == 9);
+    }
+
+    // frozen table: configuration of new functions is an error
+    state.freeze();
+    assert(&state.get_function_ref(1, 0) == &f);
+    assert(throws([&]() { state.get_function_ref(3, 0); }));
+    assert(state.get_f_list().size() == 2);
+
+    return 0;
+}
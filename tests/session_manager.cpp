@@ -0,0 +1,87 @@
+#include <cassert>
+#include <vector>
+
+#include "session_manager.h"
+
+using namespace robot;
+using namespace robot::common_protocol;
+
+int main()
+{
+    // 1 control slot (prior >= 5), 2 monitor slots (prior >= 1)
+    session_manager m(session_limits(1, 2, 5, 1));
+
+    std::vector<std::pair<int, uint16_t>> evicted;
+    m.set_evict_action
+    (
+        [&](int id, uint16_t code) { evicted.push_back(std::make_pair(id, code)); }
+    );
+
+    uint16_t code = 0;
+
+    // low priority refused
+    assert(!m.connect(0, 0, code));
+    assert(code == (DISCONNECT_LOW_PRIORITY | 1));
+
+    assert(m.connect(1, 3, code));
+    assert(m.connect(2, 6, code));
+
+    // no free slots, same priority
+    assert(!m.connect(3, 3, code));
+    assert(code == (DISCONNECT_NO_FREE_SLOTS | 4));
+
+    auto info = m.info();
+    assert(get<num_of_free_monitor_slots_key>(info) == 0);
+    assert(get<max_monitor_prior_key>(info) == 6);
+    assert(get<min_monitor_prior_key>(info) == 3);
+
+    // control level
+    assert(m.activate(1, false) == CMD_LOW_PRIORITY);
+    assert(m.activate(2, false) == CMD_DONE);
+    assert(m.is_control(2));
+
+    info = m.info();
+    assert(get<num_of_free_control_slots_key>(info) == 0);
+    assert(get<num_of_free_monitor_slots_key>(info) == 1);
+    assert(get<max_control_prior_key>(info) == 6);
+
+    // higher priority monitor evicts lowest one
+    assert(m.connect(4, 7, code));
+    assert(m.connect(5, 8, code));
+    assert(evicted.size() == 1);
+    assert(evicted[0].first == 1);
+    assert(evicted[0].second == (DISCONNECT_LOW_PRIORITY | 4)); // above evicted one
+    assert(!m.is_connected(1));
+
+    // refused newcomer needs priority above lowest monitor
+    assert(!m.connect(6, 7, code));
+    assert(code == (DISCONNECT_NO_FREE_SLOTS | 8));
+
+    // activation takes only free slots, level up moves lower priority
+    // control session to monitor slot of newcomer
+    assert(m.activate(5, false) == CMD_NO_FREE_SLOTS);
+    assert(m.activate(5, true) == CMD_DONE);
+    assert(evicted.size() == 1);
+    assert(m.is_control(5));
+    assert(m.is_connected(2) && !m.is_control(2));
+
+    info = m.info();
+    assert(get<num_of_free_control_slots_key>(info) == 0);
+    assert(get<num_of_free_monitor_slots_key>(info) == 0);
+    assert(get<max_control_prior_key>(info) == 8);
+
+    // deactivation needs free monitor slot
+    assert(m.deactivate(5) == CMD_NO_FREE_SLOTS);
+    m.disconnect(4);
+    assert(m.deactivate(5) == CMD_DONE);
+    assert(!m.is_control(5));
+
+    m.disconnect(2);
+    m.disconnect(5);
+
+    info = m.info();
+    assert(get<num_of_free_control_slots_key>(info) == 1);
+    assert(get<num_of_free_monitor_slots_key>(info) == 2);
+
+    return 0;
+}
@@ -0,0 +1,118 @@
+#include <cassert>
+#include <thread>
+#include <vector>
+
+#include "device.h"
+
+using namespace robot;
+
+using sonar_array = std::array<second<uint32_t>, 16>;
+
+static_assert(std::is_same<shared_value<sonar_array>, seqlock_value<sonar_array>>::value, "");
+static_assert(std::is_same<shared_value<std::vector<int>>, locked_value<std::vector<int>>>::value, "");
+
+int main()
+{
+    // readers see whole arrays written by one set
+    reg<sonar_array, READ_FLAG | WRITE_FLAG> r;
+
+    std::atomic<bool> stop(false);
+    std::atomic<size_t> torn(0);
+
+    std::vector<std::thread> readers;
+    for(int i = 0; i < 3; i++)
+        readers.push_back
+        (
+            std::thread
+            (
+                [&]()
+                {
+                    while(!stop) {
+                        sonar_array a = r.get();
+                        for(auto& v : a)
+                            if(v.get_value() != a[0].get_value())
+                                torn++;
+                    }
+                }
+            )
+        );
+
+    for(uint32_t n = 0; n < 100000; n++) {
+        sonar_array a;
+        a.fill(second<uint32_t>(n));
+        r.set(a);
+    }
+
+    stop = true;
+    for(auto& t : readers)
+        t.join();
+
+    assert(torn == 0);
+    assert(r.get()[15].get_value() == 99999);
+
+    // read-modify-write through parameter
+    auto p = r.make_parameter(0);
+    auto writer = p->get_value_writer();
+
+    std::vector<uint32_t> v(16, 7);
+    std::vector<char> data(16 * sizeof(uint32_t));
+    binary_ostream os(data.data(), data.size());
+    os << v;
+    binary_istream is(data.data(), data.size());
+    is >> writer;
+
+    p->set_write();
+    p->on_write();
+    assert(r.get()[3].get_value() == 7);
+
+    // protocol reads while device sets: parameter span is filled from
+    // snapshot by reader, serialized values are never torn
+    {
+        robot_state state;
+        reg<sonar_array, READ_FLAG> sonars;
+        state.get_function_ref(2, 0)[0] = sonars.make_parameter(0);
+
+        common_protocol::function_value_read_request req;
+        std::get<0>(req) = common_protocol::function_id_t(2, 0);
+        std::get<1>(req).push_back(std::tuple<uint8_t, uint8_t>(0, 0));
+
+        std::atomic<bool> done(false);
+        std::thread device
+        (
+            [&]()
+            {
+                sonar_array a;
+                for(uint32_t n = 0; !done; n++) {
+                    a.fill(second<uint32_t>(n));
+                    sonars.set(a);
+                }
+            }
+        );
+
+        common_protocol::function_value_read res;
+        std::vector<char> arena;
+        size_t torn_reads = 0;
+
+        for(size_t i = 0; i < 100000; i++) {
+            state.get_read_values(req, res);
+
+            binary_ostream os(arena);
+            std::get<0>(std::get<1>(std::get<1>(res)[0])).write(os);
+
+            std::array<uint32_t, 16> v;
+            binary_istream is(arena.data(), os.pos());
+            is >> v;
+
+            for(uint32_t x : v)
+                if(x != v[0])
+                    torn_reads++;
+        }
+
+        done = true;
+        device.join();
+
+        assert(torn_reads == 0);
+    }
+
+    return 0;
+}
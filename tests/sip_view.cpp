@@ -0,0 +1,151 @@
+#include <cassert>
+#include <cstdlib>
+#include <new>
+
+#include "../device/pioneer_2at.h"
+
+using namespace robot;
+using namespace robot::p2at;
+
+// counting allocator
+
+static size_t allocs = 0;
+
+void* operator new(size_t n)
+{
+    ++allocs;
+    void* p = malloc(n);
+    if(!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) noexcept { free(p); }
+
+using sip_body = at_key<msg_body, p2_at_msg<sip>>;
+
+template <typename F>
+bool throws(const F& f)
+{
+    try {
+        f();
+    }
+    catch(const std::logic_error&) {
+        return true;
+    }
+    return false;
+}
+
+// body as sent by robot: data and check sum
+std::vector<char> make_body(sip_body& body)
+{
+    std::vector<char> data;
+    binary_ostream ds(data);
+    ds << get<msg_data>(body);
+    data.resize(ds.pos());
+
+    get<msg_chck_sum>(body) = chck_sum_calc(data.data(), data.size());
+
+    std::vector<char> res;
+    binary_ostream os(res);
+    os << body;
+    res.resize(os.pos());
+    return res;
+}
+
+int main()
+{
+    sip_body body;
+    auto& data = get<msg_data>(body);
+    get<status_key>(data) = 0x32;
+    get<x_pos_key>(data) = 1200;
+    get<y_pos_key>(data) = 300;
+    get<th_pos_key>(data) = -45;
+    get<l_vel_key>(data) = 250;
+    get<r_vel_key>(data) = -250;
+    get<compass>(data) = 7;
+    get<timer>(data) = 0x1234;
+    get<digout>(data) = 0x5A;
+
+    auto& sonars = get<sonar_measurements>(data);
+    sonars.resize(16);
+    for(size_t i = 0; i < sonars.size(); i++) {
+        get<sonar_number>(sonars[i]) = i;
+        get<sonar_range>(sonars[i]) = mm(1000 + i);
+    }
+
+    std::vector<char> packet = make_body(body);
+
+    // fields read in place, no allocations
+    {
+        size_t n = allocs;
+
+        sip_view v(packet.data(), packet.size());
+
+        assert(v.get<status_key>() == 0x32);
+        assert(v.x_pos().get_value() == 1200);
+        assert(v.y_pos().get_value() == 300);
+        assert(v.th_pos() == -45);
+        assert(v.l_vel().get_value() == 250);
+        assert(v.r_vel().get_value() == -250);
+        assert(v.get<compass>() == 7);
+        assert(v.get<timer>() == 0x1234);
+        assert(v.get<digout>() == 0x5A);
+
+        assert(v.sonar_count() == 16);
+        size_t i = 0;
+        for(auto it = v.sonars_begin(); it != v.sonars_end(); ++it, ++i) {
+            assert(get<sonar_number>(*it) == i);
+            assert(get<sonar_range>(*it).get_value() == int16_t(1000 + i));
+        }
+        assert(i == 16);
+
+        assert(allocs == n);
+    }
+
+    // same as tuple decoding
+    {
+        sip_body decoded;
+        binary_istream is(packet.data(), packet.size());
+        is >> decoded;
+
+        sip_view v(packet.data(), packet.size());
+        assert(v.get<flags>() == get<flags>(get<msg_data>(decoded)));
+        assert(v.get<analog>() == get<analog>(get<msg_data>(decoded)));
+    }
+
+    // no sonars
+    {
+        sonars.clear();
+        std::vector<char> p = make_body(body);
+
+        sip_view v(p.data(), p.size());
+        assert(v.sonar_count() == 0);
+        assert(v.sonars_begin() == v.sonars_end());
+        assert(v.get<timer>() == 0x1234);
+    }
+
+    // corrupted and truncated packets
+    {
+        std::vector<char> p = packet;
+        p[5] ^= 1;
+        assert(throws([&]() { sip_view(p.data(), p.size()); }));
+
+        assert(throws([&]() { sip_view(packet.data(), 10); }));
+
+        // sonar count beyond data, check sum is valid
+        sonars.resize(2);
+        p = make_body(body);
+        p[19] = 40;
+        size_t size = p.size() - 2;
+        uint16_t sum = chck_sum_calc(p.data(), size);
+        binary_ostream os(p.data() + size, 2);
+        os << sum;
+        assert(throws([&]() { sip_view(p.data(), p.size()); }));
+    }
+
+    const char head[] = { (char)0xFA, (char)0xFB, 0 };
+    assert(check_head(head) && !check_head(head + 1));
+
+    return 0;
+}
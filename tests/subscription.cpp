@@ -0,0 +1,104 @@
+#include <cassert>
+#include <sstream>
+
+#include "device.h"
+#include "subscription.h"
+
+using namespace robot;
+using namespace robot::common_protocol;
+
+std::string value_str(const function_value_read& m, size_t i)
+{
+    std::stringstream s;
+    std::get<0>(std::get<1>(std::get<1>(m)[i])).write(s);
+    return s.str();
+}
+
+int main()
+{
+    reactor loop;
+    robot_state state;
+
+    reg<second<uint32_t>, READ_FLAG | WRITE_FLAG> r0;
+    reg<second<uint32_t>, READ_FLAG> r1;
+
+    auto& f = state.get_function_ref(1, 0);
+    f = move_control_function();
+    f[0xE] = r0.make_parameter(0xE);
+    f[0xF] = r1.make_parameter(0xF);
+
+    std::vector<std::pair<session_id, function_value_read>> sent;
+
+    auto send =
+    [&](session_id id, const function_value_read& m)
+    {
+        sent.push_back(std::make_pair(id, m));
+    };
+
+    // on update: coalescing while client is not ready
+    {
+        bool ready = false;
+
+        change_notifier n(loop, state, send, [&](session_id) { return ready; });
+
+        n.subscribe(1, 1, 0, std::vector<uint8_t>{ 0xE, 0xF }, false);
+        n.subscribe(2, 1, 0, std::vector<uint8_t>{ 0xE, 0xF }, true);
+
+        r0.set(second<uint32_t>(1));
+        r1.set(second<uint32_t>(2));
+        r0.set(second<uint32_t>(3));
+
+        loop.run_once(0);
+        assert(sent.empty());
+
+        ready = true;
+        n.flush();
+
+        // one message per client
+        assert(sent.size() == 2);
+        for(auto& m : sent) {
+            assert(std::get<1>(m.second).size() == 2);
+            assert(value_str(m.second, 0) == "3");
+            assert(value_str(m.second, 1) == "2");
+        }
+
+        // one time request is done, continuous is cancelled
+        sent.clear();
+        n.cancel(1, 1, 0, std::vector<uint8_t>{ 0xF });
+        r0.set(second<uint32_t>(4));
+        r1.set(second<uint32_t>(5));
+        loop.run_once(0);
+
+        assert(sent.size() == 1 && sent[0].first == 1);
+        assert(std::get<1>(sent[0].second).size() == 1);
+        assert(value_str(sent[0].second, 0) == "4");
+
+        sent.clear();
+        n.cancel(1);
+        r0.set(second<uint32_t>(6));
+        loop.run_once(0);
+        assert(sent.empty());
+    }
+
+    // periodical: one timer per period
+    {
+        periodic_scheduler p(loop, state, send);
+
+        p.subscribe(1, 1, 0, std::vector<uint8_t>{ 0xE }, 2000);
+        p.subscribe(2, 1, 0, std::vector<uint8_t>{ 0xE, 0xF }, 2000);
+        assert(p.group_count() == 1);
+
+        p.subscribe(1, 1, 0, std::vector<uint8_t>{ 0xE }, 3000);
+        assert(p.group_count() == 2);
+
+        sent.clear();
+        while(sent.size() < 4)
+            loop.run_once(10);
+
+        p.cancel(2);
+        p.cancel(1, 1, 0, std::vector<uint8_t>());
+        assert(p.group_count() == 0);
+    }
+
+    return 0;
+}
@@ -0,0 +1,54 @@
+#include <cassert>
+#include <thread>
+
+#include "timer_wheel.h"
+
+using namespace robot;
+
+void wait_ms(int ms) { std::this_thread::sleep_for(std::chrono::milliseconds(ms)); }
+
+int main()
+{
+    timer_wheel w;
+    assert(w.next_timeout_ms() == -1);
+
+    int a = 0, b = 0;
+    w.add(5000, [&a]() { a++; });
+    int t = w.next_timeout_ms();
+    assert(t >= 1 && t <= 5);
+
+    // cancelled timer: early wake up at most
+    auto id = w.add(2000, [&b]() { b++; });
+    assert(w.next_timeout_ms() <= 2);
+    w.cancel(id);
+
+    wait_ms(10);
+    w.advance();
+    assert(a == 1 && b == 0);
+    assert(w.empty());
+
+    // next round: slot of other round is not the expiry
+    w.add(1000000, [&a]() { a++; });
+    t = w.next_timeout_ms();
+    assert(t > 0 && t <= 256);
+
+    wait_ms(t);
+    w.advance();
+    assert(a == 1);
+    t = w.next_timeout_ms();
+    assert(t > 0 && t <= 256);
+
+    // periodic timer is rescheduled
+    timer_wheel p;
+    int n = 0;
+    p.add(2000, [&n]() { n++; }, true);
+    for(size_t i = 0; i < 3; i++) {
+        int d = p.next_timeout_ms();
+        assert(d >= 0 && d <= 2);
+        wait_ms(d + 1);
+        p.advance();
+    }
+    assert(n >= 3);
+
+    return 0;
+}
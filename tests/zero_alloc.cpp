@@ -0,0 +1,288 @@
+#include <cassert>
+#include <cstdlib>
+#include <new>
+
+#include "device.h"
+
+using namespace robot;
+using namespace robot::common_protocol;
+
+// counting allocator
+
+static size_t allocs = 0;
+
+void* operator new(size_t n)
+{
+    ++allocs;
+    void* p = malloc(n);
+    if(!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) noexcept { free(p); }
+
+static size_t writes = 0;
+
+// in memory one direction pipe
+
+struct fifo
+{
+    char data[1 << 16];
+    size_t head = 0;
+    size_t tail = 0;
+};
+
+class pipe_socket
+{
+    fifo* in;
+    fifo* out;
+public:
+    pipe_socket(fifo* i, fifo* o): in(i), out(o) {}
+
+    int read(char* dst, size_t n)
+    {
+        assert(in->tail - in->head >= n);
+        std::copy(in->data + in->head, in->data + in->head + n, dst);
+        in->head += n;
+        if(in->head == in->tail)
+            in->head = in->tail = 0;
+        return n;
+    }
+
+    int write(const char* src, size_t n)
+    {
+        assert(sizeof(out->data) - out->tail >= n);
+        ++writes;
+        std::copy(src, src + n, out->data + out->tail);
+        out->tail += n;
+        return n;
+    }
+};
+
+// sizes of constant size messages are compile time constants
+
+static_assert(static_size<message_header>::value == 14, "header size");
+static_assert(is_constant_size<message<service_group_key, active_connections_info_key>>::value, "");
+static_assert(!is_constant_size<function_value_read_request>::value, "");
+
+template <typename T>
+size_t traverse_size(const T& t)
+{
+    size_calc_stream s;
+    s << t;
+    return s.get();
+}
+
+int main()
+{
+    fifo to_server, to_client;
+
+    // variable size messages: only variable parts are traversed
+    {
+        function_value_read_request req;
+        std::get<1>(req).resize(5);
+        assert(calc_size(req) == traverse_size(req));
+        assert(calc_size(req) == 2 + 2 + 1 + 5 * 2);
+    }
+
+    // single pass message: growable stream, patched data size
+    {
+        function_value_read_request req;
+        std::get<0>(req) = function_id_t(1, 0);
+        std::get<1>(req).resize(300);
+
+        std::vector<char> out(3, 'x');
+        binary_ostream os(out, 3);
+        write_message<data_access_group_key, function_value_read_request_key>(os, req, 5);
+        out.resize(3 + os.pos());
+
+        auto m = make_message<data_access_group_key, function_value_read_request_key>(req, 5);
+        binary_buffer ref = make_buffer(m);
+
+        assert(out.size() == 3 + ref.size);
+        assert(std::equal(ref.data, ref.data + ref.size, out.begin() + 3));
+        assert(out[0] == 'x');
+    }
+
+    // framing: constant size messages
+    {
+        connection c(pipe_socket(&to_server, &to_server));
+
+        message<service_group_key, active_connections_info_key> m, r;
+        get<max_control_prior_key>(get<body_key>(m)) = 7;
+
+        size_t n = 0;
+        for(size_t i = 0; i < 100; i++) {
+            if(i == 2)
+                n = allocs;
+
+            c.write(m);
+            c.read(r);
+        }
+
+        assert(allocs == n);
+        assert(get<max_control_prior_key>(get<body_key>(r)) == 7);
+    }
+
+    // batched framing: one socket write per batch
+    {
+        connection c(pipe_socket(&to_server, &to_server));
+
+        message<service_group_key, active_connections_info_key> m, r;
+
+        size_t w = writes;
+        {
+            write_batch b(c);
+            for(size_t i = 0; i < 10; i++) {
+                get<max_control_prior_key>(get<body_key>(m)) = i;
+                c.write(m);
+            }
+        }
+        assert(writes == w + 1);
+
+        for(size_t i = 0; i < 10; i++) {
+            c.read(r);
+            assert(get<max_control_prior_key>(get<body_key>(r)) == i);
+        }
+    }
+
+    // request / response
+    {
+        server srv(pipe_socket(&to_server, &to_client));
+        connection cli(pipe_socket(&to_client, &to_server));
+
+        srv.get_function_ref(1, 0) = move_control_function();
+
+        function_value_read_request req;
+        std::get<0>(req) = function_id_t(1, 0);
+
+        message_header header;
+        uint16_t f_code = 0, f_number = 0;
+        uint8_t count = 0;
+
+        size_t n = 0;
+        for(size_t i = 0; i < 100; i++) {
+            if(i == 2)
+                n = allocs;
+
+            cli.write
+            (
+                std::forward_as_tuple
+                (
+                    make_header
+                    <
+                        data_access_group_key,
+                        function_value_read_request_key
+                    >(req),
+                    req
+                )
+            );
+
+            srv.server_package_parse();
+
+            cli.read(header);
+            binary_istream is = cli.read_stream(get<data_size_key>(header));
+            is >> f_code >> f_number >> count;
+        }
+
+        assert(allocs == n);
+        assert(get<type_key>(header) == function_value_read_key::value);
+        assert(f_code == 1 && f_number == 0 && count == 0);
+    }
+
+    // read of 20 parameters: values are referenced in place
+    {
+        server srv(pipe_socket(&to_server, &to_client));
+        connection cli(pipe_socket(&to_client, &to_server));
+
+        std::array<reg<second<uint32_t>, READ_FLAG>, 20> regs;
+
+        auto& f = srv.get_function_ref(2, 0);
+        for(uint8_t i = 0; i < regs.size(); i++) {
+            f[i] = regs[i].make_parameter(i);
+            regs[i].set(second<uint32_t>(100 + i));
+        }
+
+        function_value_read_request req;
+        std::get<0>(req) = function_id_t(2, 0);
+        for(uint8_t i = 0; i < regs.size(); i++)
+            std::get<1>(req).push_back(std::tuple<uint8_t, uint8_t>(i, 0));
+
+        message_header header;
+        uint16_t f_code = 0, f_number = 0;
+        uint8_t count = 0, p_code = 0, flags = 0;
+        uint32_t v = 0;
+
+        size_t n = 0;
+        for(size_t i = 0; i < 100; i++) {
+            if(i == 2)
+                n = allocs;
+
+            cli.write_stream
+            (
+                [&req](binary_ostream& os)
+                {
+                    write_message
+                    <
+                        data_access_group_key,
+                        function_value_read_request_key
+                    >(os, req);
+                }
+            );
+
+            srv.server_package_parse();
+
+            cli.read(header);
+            binary_istream is = cli.read_stream(get<data_size_key>(header));
+            is >> f_code >> f_number >> count;
+
+            for(uint8_t j = 0; j < count; j++) {
+                is >> p_code >> v >> flags;
+                assert(p_code == j && v == 100u + j);
+            }
+        }
+
+        assert(allocs == n);
+        assert(f_code == 2 && f_number == 0 && count == 20);
+    }
+
+    // unbound and unknown types: command_return_code CMD_NOT_SUPPORTED
+    {
+        server srv(pipe_socket(&to_server, &to_client));
+        connection cli(pipe_socket(&to_client, &to_server));
+
+        cli.write
+        (
+            make_message
+            <
+                config_group_key,
+                config_version_request_key
+            >(config_version_request(), 11)
+        );
+
+        message_header header;
+        get<group_key      >(header) = data_access_group_key::value;
+        get<type_key       >(header) = 0x40;
+        get<message_num_key>(header) = 12;
+        get<data_size_key  >(header) = 0;
+        cli.write(header);
+
+        message<service_group_key, command_return_code_key> ret;
+
+        for(uint32_t num = 11; num <= 12; num++) {
+            srv.server_package_parse();
+
+            cli.read(ret);
+            assert(get<command_num_key>(get<body_key>(ret)) == num);
+            assert(get<return_code_key>(get<body_key>(ret)) == CMD_NOT_SUPPORTED);
+        }
+
+        // replies are not answered
+        cli.write(ret);
+        srv.server_package_parse();
+        assert(to_client.tail == to_client.head);
+    }
+
+    return 0;
+}